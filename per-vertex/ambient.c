@@ -0,0 +1,75 @@
+/*
+	Ambient, emissive and hemisphere lighting, see ambient.h
+*/
+
+#include <kos.h>
+#include "ambient.h"
+
+AmbientInfo Ambient = {{0,0,0,0},{0,0,0,0},{0,0,0,0},{0,0,1.0f,0}};
+
+static int Dirty = 1;
+
+void Ambient_Set(float r,float g,float b){
+	Ambient.ambient.x = r;
+	Ambient.ambient.y = g;
+	Ambient.ambient.z = b;
+	Dirty = 1;
+}
+
+void Ambient_Hemisphere(const Vector3* sky,const Vector3* ground,const Vector3* up){
+	Ambient.sky = *sky;
+	Ambient.ground = *ground;
+	normalize((void*)up,&Ambient.up);
+	Dirty = 1;
+}
+
+/*
+	The layer, its materials or the bake changed
+*/
+void Ambient_Invalidate(){
+	Dirty = 1;
+}
+
+static float Seed(float emissive,float ambient,float global,float sky,float ground,float t){
+	float c = emissive + ambient*(global + ground + (sky - ground)*t);
+	return c < 1.0f ? (c > 0.0f ? c : 0.0f) : 1.0f;
+}
+
+/*
+	Call before lighting, redoes Quad.base and the colours the frame
+	starts from when anything changed
+*/
+void Ambient_Update(){
+	int i,j;
+
+	if(!Dirty)
+		return;
+	Dirty = 0;
+	for(i = 0; i < LayerSize;i++){
+		Quad* qd = &Layer[i];
+		const Material* m = &qd->mat;
+		Vector3 a,b,n,nn;
+		float t;
+
+		a.x = qd->verts[1].p.x - qd->verts[0].p.x;
+		a.y = qd->verts[1].p.y - qd->verts[0].p.y;
+		a.z = qd->verts[1].p.z - qd->verts[0].p.z;
+		b.x = qd->verts[2].p.x - qd->verts[0].p.x;
+		b.y = qd->verts[2].p.y - qd->verts[0].p.y;
+		b.z = qd->verts[2].p.z - qd->verts[0].p.z;
+		Cross(&a,&b,&n);
+		normalize(&n,&nn);
+		t = 0.5f + 0.5f*(nn.x*Ambient.up.x + nn.y*Ambient.up.y + nn.z*Ambient.up.z);
+
+		qd->base.x = Seed(m->Emissive.x,m->Ambient.x,Ambient.ambient.x,Ambient.sky.x,Ambient.ground.x,t);
+		qd->base.y = Seed(m->Emissive.y,m->Ambient.y,Ambient.ambient.y,Ambient.sky.y,Ambient.ground.y,t);
+		qd->base.z = Seed(m->Emissive.z,m->Ambient.z,Ambient.ambient.z,Ambient.sky.z,Ambient.ground.z,t);
+		qd->base.w = 1.0f;
+		for(j = 0; j < 4;j++){
+			Vertex* v = &qd->verts[j];
+			v->FinalColor.x = MIN(v->c.x + qd->base.x,1.0f);
+			v->FinalColor.y = MIN(v->c.y + qd->base.y,1.0f);
+			v->FinalColor.z = MIN(v->c.z + qd->base.z,1.0f);
+		}
+	}
+}
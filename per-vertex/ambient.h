@@ -0,0 +1,32 @@
+#ifndef AMBIENT_H
+#define AMBIENT_H
+
+#include "light.h"
+
+/*
+	Ambient, emissive and hemisphere lighting
+	- Worked out per quad into Quad.base only when something it
+	  depends on changes, Draw_Quad() then starts FinalColor from
+	  c + base instead of c alone, so the lights add on top of it
+	- base = Emissive + Ambient * (global ambient + hemisphere), the
+	  hemisphere fades from ground to sky as the normal turns to up.
+	  The quads' normals point along +z, so with the default up of
+	  0 0 1 a flat layer gets the sky colour
+	- Everything defaults to black, which lights like before
+*/
+
+typedef struct {
+	Vector3 ambient;	// global, scaled by each Material.Ambient
+	Vector3 sky;	// hemisphere colour facing up
+	Vector3 ground;	// and facing away from it
+	Vector3 up;	// unit length, 0 0 1 is the way the layer's quads face
+}AmbientInfo;
+
+extern AmbientInfo Ambient;
+
+void Ambient_Set(float r,float g,float b);
+void Ambient_Hemisphere(const Vector3* sky,const Vector3* ground,const Vector3* up);
+void Ambient_Invalidate();
+void Ambient_Update();
+
+#endif
@@ -0,0 +1,178 @@
+/*
+	Light animation, see anim.h
+*/
+
+#include <kos.h>
+#include "anim.h"
+#include "scene.h"
+
+#define TWO_PI 6.2831853f
+
+static int Count;	// slots up to the last animated light
+static Uint8 Active[MAX_LIGHTS];
+static float Base[3][MAX_LIGHTS];	// colour the terms scale
+static float Flicker[MAX_LIGHTS],FlickerRate[MAX_LIGHTS];
+static float Pulse[MAX_LIGHTS],PulseRate[MAX_LIGHTS];
+static float Phase[MAX_LIGHTS],CycleRate[MAX_LIGHTS];
+static float Scale[MAX_LIGHTS];
+static int Keys[MAX_LIGHTS];
+static float PathTime[MAX_LIGHTS];
+static float Path[MAX_LIGHTS][ANIM_MAX_KEYS][3];
+
+static void Recount(){
+	Count = MAX_LIGHTS;
+	while(Count > 0 && !Active[Count - 1])
+		Count--;
+}
+
+/*
+	-1 for a static light while a bake is loaded, its colour is in the
+	vertex colours already and the runtime never lights it
+*/
+int Light_Anim_Set(int light,const LightAnim* a){
+	Light* l;
+	int k;
+
+	if(light < 0 || light >= MAX_LIGHTS)
+		return -1;
+	l = &Lights[light];
+	if(LightsBaked && !(l->flags & LIGHT_DYNAMIC))
+		return -1;
+	Active[light] = 1;
+	Base[0][light] = l->r;
+	Base[1][light] = l->g;
+	Base[2][light] = l->b;
+	Flicker[light] = a->flicker;
+	FlickerRate[light] = a->flicker_rate;
+	Pulse[light] = a->pulse;
+	PulseRate[light] = a->pulse_rate;
+	Phase[light] = a->phase;
+	CycleRate[light] = a->cycle_rate;
+	Keys[light] = a->keys >= 2 ? MIN(a->keys,ANIM_MAX_KEYS) : 0;
+	PathTime[light] = a->path_time > 0.0f ? a->path_time : 1.0f;
+	for(k = 0; k < Keys[light];k++){
+		Path[light][k][0] = a->path[k][0];
+		Path[light][k][1] = a->path[k][1];
+		Path[light][k][2] = a->path[k][2];
+	}
+	Recount();
+	return 0;
+}
+
+/*
+	Puts the light back to the colour it was set with, a path light
+	stays wherever it got to
+*/
+void Light_Anim_Stop(int light){
+	if(light < 0 || light >= MAX_LIGHTS || !Active[light])
+		return;
+	Active[light] = 0;
+	Lights[light].r = Base[0][light];
+	Lights[light].g = Base[1][light];
+	Lights[light].b = Base[2][light];
+	Recount();
+}
+
+/*
+	The light was recoloured from outside, animate the new colour
+*/
+void Light_Anim_Rebase(int light){
+	if(light < 0 || light >= MAX_LIGHTS || !Active[light])
+		return;
+	Base[0][light] = Lights[light].r;
+	Base[1][light] = Lights[light].g;
+	Base[2][light] = Lights[light].b;
+}
+
+/*
+	Stops every animation, for when a scene replaces the lights
+*/
+void Light_Anim_Reset(){
+	int i;
+	for(i = 0; i < MAX_LIGHTS;i++)
+		Light_Anim_Stop(i);
+}
+
+/*
+	Value noise in 0..1, smoothstepped between integer steps
+*/
+static float Hash(Uint32 n){
+	n = (n << 13) ^ n;
+	n = n * (n * n * 15731u + 789221u) + 1376312589u;
+	return (float)(n & 0xffffff) * (1.0f / 16777215.0f);
+}
+
+static float Noise(int seed,float t){
+	int i = (int)t;
+	float f = t - (float)i;
+	float a = Hash((Uint32)i * 97u + (Uint32)seed * 7919u);
+	float b = Hash((Uint32)(i + 1) * 97u + (Uint32)seed * 7919u);
+	f = f*f*(3.0f - 2.0f*f);
+	return a + (b - a)*f;
+}
+
+static void Path_Point(int i,float t,float* out){
+	int n = Keys[i];
+	float u = t / PathTime[i];
+	int k,c;
+
+	u = (u - (float)(int)u) * (float)n;
+	k = (int)u;
+	u -= (float)k;
+	for(c = 0; c < 3;c++){
+		float p0 = Path[i][(k + n - 1) % n][c];
+		float p1 = Path[i][k % n][c];
+		float p2 = Path[i][(k + 1) % n][c];
+		float p3 = Path[i][(k + 2) % n][c];
+		out[c] = 0.5f*((2.0f*p1) + (p2 - p0)*u + (2.0f*p0 - 5.0f*p1 + 4.0f*p2 - p3)*u*u
+			+ (3.0f*p1 - p0 - 3.0f*p2 + p3)*u*u*u);
+	}
+}
+
+/*
+	Call once a frame before lighting, t in seconds. Returns the number
+	of animated lights
+*/
+int Light_Anim_Update(float t){
+	int i,n = 0;
+
+	if(t < 0.0f)
+		t = 0.0f;
+	for(i = 0; i < Count;i++)
+		Scale[i] = 1.0f;
+	for(i = 0; i < Count;i++)
+		Scale[i] *= 1.0f - Flicker[i]*Noise(i,t*FlickerRate[i]);
+	for(i = 0; i < Count;i++)
+		Scale[i] *= 1.0f - Pulse[i]*(0.5f - 0.5f*fcos(TWO_PI*(t*PulseRate[i] + Phase[i])));
+
+	for(i = 0; i < Count;i++){
+		Light* l = &Lights[i];
+		float s = Scale[i];
+		if(!Active[i])
+			continue;
+		if(CycleRate[i] != 0.0f){
+			float peak = MAX(Base[0][i],MAX(Base[1][i],Base[2][i]));
+			float a = TWO_PI*(t*CycleRate[i] + Phase[i]);
+			l->r = s*peak*(0.5f + 0.5f*fcos(a));
+			l->g = s*peak*(0.5f + 0.5f*fcos(a - TWO_PI/3.0f));
+			l->b = s*peak*(0.5f + 0.5f*fcos(a - 2.0f*TWO_PI/3.0f));
+		}else{
+			l->r = s*Base[0][i];
+			l->g = s*Base[1][i];
+			l->b = s*Base[2][i];
+		}
+		n++;
+	}
+
+	for(i = 0; i < Count;i++){
+		float p[3];
+		if(!Active[i] || !Keys[i])
+			continue;
+		Path_Point(i,t,p);
+		Lights[i].x = p[0];
+		Lights[i].y = p[1];
+		Lights[i].z = p[2];
+		LightsDirty |= 1u << i;
+	}
+	return n;
+}
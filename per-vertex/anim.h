@@ -0,0 +1,47 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include "light.h"
+
+/*
+	Light animation
+	- Flicker (smoothed value noise), pulse (sine), colour cycling and
+	  looping Catmull-Rom paths, any mix of them on one light
+	- Light_Anim_Update() evaluates every animated light once a frame,
+	  one pass per term over flat per-light arrays
+	- The colour terms scale the light's colour as it was when the
+	  animation was set. Only paths put the light in LightsDirty, a
+	  light that isn't in it keeps its cached N.L*atten (kernels.c)
+	  and a colour change costs a multiply-add per vertex
+	- Static lights can't be animated while a bake is loaded, the
+	  baker already put them in the vertex colours. Light_Anim_Set()
+	  turns them down and Load_Bake() stops any that were animating
+
+	A torch:
+		LightAnim a = {0};
+		a.flicker = 0.4f;
+		a.flicker_rate = 12.0f;
+		Light_Anim_Set(0,&a);
+*/
+
+#define ANIM_MAX_KEYS 8
+
+typedef struct {
+	float flicker;	// 0..1 of the colour the noise can take away
+	float flicker_rate;	// noise steps a second
+	float pulse;	// 0..1 of the colour gone at the bottom of the pulse
+	float pulse_rate;	// pulses a second
+	float phase;	// 0..1 of a pulse or cycle, to keep alarms apart
+	float cycle_rate;	// hue turns a second, 0 keeps the colour
+	int keys;	// path points, fewer than 2 leaves the light where it is
+	float path_time;	// seconds for one loop of the path
+	float path[ANIM_MAX_KEYS][3];
+}LightAnim;
+
+int Light_Anim_Set(int light,const LightAnim* a);
+void Light_Anim_Stop(int light);
+void Light_Anim_Rebase(int light);
+void Light_Anim_Reset();
+int Light_Anim_Update(float t);
+
+#endif
@@ -0,0 +1,39 @@
+/*
+	Linear scratch allocator, see arena.h
+*/
+
+#include <kos.h>
+#include "arena.h"
+
+static Uint8 FrameMem[FRAME_ARENA_SIZE] __attribute__((aligned(32)));
+
+Arena FrameArena = {FrameMem,FRAME_ARENA_SIZE,0,0,0};
+
+void Arena_Init(Arena* a,void* mem,Uint32 size){
+	a->base = mem;
+	a->size = size;
+	a->used = 0;
+	a->peak = 0;
+	a->failed = 0;
+}
+
+void* Arena_Alloc(Arena* a,Uint32 bytes){
+	Uint32 at = (a->used + 31) & ~31;
+	if(bytes > a->size || at > a->size - bytes){
+		a->failed++;
+		return NULL;
+	}
+	a->used = at + bytes;
+	if(a->used > a->peak)
+		a->peak = a->used;
+	return a->base + at;
+}
+
+void Arena_Reset(Arena* a){
+	a->used = 0;
+}
+
+void Arena_Print_Stats(const char* name,const Arena* a){
+	printf("%s: peak %u of %u bytes, %u allocations didn't fit\n",name,
+		(unsigned)a->peak,(unsigned)a->size,(unsigned)a->failed);
+}
@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "light.h"
+
+/*
+	Linear scratch allocator
+	- FrameArena holds everything that only lives for one frame, it's
+	  reset right before pvr_scene_begin() so nothing is freed by hand
+	- Allocations are 32 byte aligned (a cache line on the SH4) and
+	  come back NULL when the arena is full, callers fall back to
+	  doing the work without the scratch
+	- Nothing here is locked, hand out worker scratch before forking
+*/
+
+#ifndef FRAME_ARENA_SIZE
+#define FRAME_ARENA_SIZE (64*1024)
+#endif
+
+typedef struct {
+	Uint8* base;
+	Uint32 size;
+	Uint32 used;
+	Uint32 peak;	// high water mark over every reset
+	Uint32 failed;	// allocations that didn't fit
+}Arena;
+
+extern Arena FrameArena;
+
+void Arena_Init(Arena* a,void* mem,Uint32 size);
+void* Arena_Alloc(Arena* a,Uint32 bytes);
+void Arena_Reset(Arena* a);
+void Arena_Print_Stats(const char* name,const Arena* a);
+
+#define Arena_New(a,type,count) ((type*)Arena_Alloc((a),sizeof(type)*(count)))
+
+#endif
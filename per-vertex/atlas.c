@@ -0,0 +1,103 @@
+/*
+	Texture atlases
+	- "<file>.atl" is text, a "DATL w h count" line then one
+	  "name x y w h" line per region
+*/
+
+#include <kos.h>
+#include "atlas.h"
+#include "texture.h"
+
+/*
+	Reads the region table, UVs are worked out from the atlas size
+*/
+static int Load_Atlas_Regions(const char* fn,Atlas* a){
+	char line[128];
+	char pf[72];
+	int w,h,count,i;
+	FILE* fp;
+
+	if(strlen(fn) + 5 > sizeof(pf))
+		return -1;
+	strcpy(pf,fn);
+	strcat(pf,".atl");
+	fp = fopen(pf,"r");
+	if(fp == NULL)
+		return -1;
+	if(fgets(line,sizeof(line),fp) == NULL || sscanf(line,"DATL %d %d %d",&w,&h,&count) != 3
+		|| w <= 0 || h <= 0 || count < 0){
+		fclose(fp);
+		return -1;
+	}
+	a->regions = malloc(count * sizeof(AtlasRegion));
+	if(a->regions == NULL && count > 0){
+		fclose(fp);
+		return -1;
+	}
+	a->count = 0;
+	for(i = 0; i < count && fgets(line,sizeof(line),fp);i++){
+		AtlasRegion* r = &a->regions[a->count];
+		if(sscanf(line,"%31s %u %u %u %u",r->name,&r->x,&r->y,&r->w,&r->h) != 5)
+			continue;
+		r->u0 = (r->x + 0.5f) / w;
+		r->v0 = (r->y + 0.5f) / h;
+		r->u1 = (r->x + r->w - 0.5f) / w;
+		r->v1 = (r->y + r->h - 0.5f) / h;
+		a->count++;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/*
+	Acquires the atlas texture through the cache (so it may still be
+	streaming in) and reads its regions
+*/
+int Load_Atlas(const char* fn,Atlas* a){
+	a->tex = NULL;
+	a->regions = NULL;
+	a->count = 0;
+	if(Load_Atlas_Regions(fn,a) != 0)
+		return -1;
+	a->tex = Tex_Acquire(fn);
+	if(a->tex == NULL){
+		Free_Atlas(a);
+		return -1;
+	}
+	return 0;
+}
+
+void Free_Atlas(Atlas* a){
+	Tex_Unref(a->tex);
+	free(a->regions);
+	a->tex = NULL;
+	a->regions = NULL;
+	a->count = 0;
+}
+
+const AtlasRegion* Atlas_Find(const Atlas* a,const char* name){
+	int i;
+	for(i = 0; i < a->count;i++)
+		if(strcmp(a->regions[i].name,name) == 0)
+			return &a->regions[i];
+	return NULL;
+}
+
+/*
+	Points the quad at a region, NULL uses the whole texture
+*/
+void Set_Quad_Region(Quad* qd,Texture* tex,const AtlasRegion* r){
+	float u0 = r ? r->u0 : 0.0f;
+	float v0 = r ? r->v0 : 0.0f;
+	float u1 = r ? r->u1 : 1.0f;
+	float v1 = r ? r->v1 : 1.0f;
+	qd->mat.texture = tex;
+	qd->verts[0].p.u = u0;
+	qd->verts[0].p.v = v0;
+	qd->verts[1].p.u = u1;
+	qd->verts[1].p.v = v0;
+	qd->verts[2].p.u = u0;
+	qd->verts[2].p.v = v1;
+	qd->verts[3].p.u = u1;
+	qd->verts[3].p.v = v1;
+}
@@ -0,0 +1,33 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include "light.h"
+
+/*
+	Texture atlases built by tools/mkatlas.c
+	- The atlas texture comes from the texture cache, "<file>.atl"
+	  next to it names the sub-rectangles
+	- Region UVs are inset by half a texel so bilinear filtering
+	  doesn't pull in the neighbouring tile
+*/
+
+#define ATLAS_NAME 32
+
+typedef struct {
+	char name[ATLAS_NAME];
+	Uint32 x,y,w,h;	// texels
+	float u0,v0,u1,v1;
+}AtlasRegion;
+
+typedef struct {
+	Texture* tex;
+	int count;
+	AtlasRegion* regions;
+}Atlas;
+
+int Load_Atlas(const char* fn,Atlas* a);
+void Free_Atlas(Atlas* a);
+const AtlasRegion* Atlas_Find(const Atlas* a,const char* name);
+void Set_Quad_Region(Quad* qd,Texture* tex,const AtlasRegion* r);
+
+#endif
@@ -0,0 +1,164 @@
+/*
+	Render command ring, see commands.h
+*/
+
+#include <kos.h>
+#include "commands.h"
+#include "shadow.h"
+#include "scene.h"
+#include "anim.h"
+#include "ambient.h"
+
+CmdRing RenderCmds;
+
+/*
+	Producer side
+*/
+int Cmd_Push(CmdRing* ring,const RenderCmd* cmd){
+	Uint32 head = ring->head;
+	if(head - __atomic_load_n(&ring->tail,__ATOMIC_ACQUIRE) >= CMD_RING_SIZE){
+		ring->dropped++;
+		return -1;
+	}
+	ring->cmds[head & (CMD_RING_SIZE - 1)] = *cmd;
+	__atomic_store_n(&ring->head,head + 1,__ATOMIC_RELEASE);
+	return 0;
+}
+
+static int Push_Light(Uint32 type,int light,float a,float b,float c,float d){
+	RenderCmd cmd;
+	cmd.type = type;
+	cmd.index = light;
+	cmd.f[0] = a;
+	cmd.f[1] = b;
+	cmd.f[2] = c;
+	cmd.f[3] = d;
+	cmd.texture = cmd.bumpmap = NULL;
+	return Cmd_Push(&RenderCmds,&cmd);
+}
+
+int Cmd_Light_Move(int light,float dx,float dy,float dz){
+	return Push_Light(CMD_LIGHT_MOVE,light,dx,dy,dz,0.0f);
+}
+
+int Cmd_Light_Pos(int light,float x,float y,float z){
+	return Push_Light(CMD_LIGHT_POS,light,x,y,z,0.0f);
+}
+
+int Cmd_Light_Color(int light,float r,float g,float b,float a){
+	return Push_Light(CMD_LIGHT_COLOR,light,r,g,b,a);
+}
+
+int Cmd_Light_Atten(int light,float ac,float ab,float aa,float radius){
+	return Push_Light(CMD_LIGHT_ATTEN,light,ac,ab,aa,radius);
+}
+
+int Cmd_Light_Count(int count){
+	return Push_Light(CMD_LIGHT_COUNT,count,0.0f,0.0f,0.0f,0.0f);
+}
+
+int Cmd_Shadows(int on){
+	return Push_Light(CMD_SHADOWS,on,0.0f,0.0f,0.0f,0.0f);
+}
+
+int Cmd_Ambient(float r,float g,float b){
+	return Push_Light(CMD_AMBIENT,0,r,g,b,0.0f);
+}
+
+int Cmd_Tile_Material(float x,float y,Texture* texture,Texture* bumpmap){
+	RenderCmd cmd;
+	cmd.type = CMD_TILE_MATERIAL;
+	cmd.index = 0;
+	cmd.f[0] = x;
+	cmd.f[1] = y;
+	cmd.f[2] = cmd.f[3] = 0.0f;
+	cmd.texture = texture;
+	cmd.bumpmap = bumpmap;
+	return Cmd_Push(&RenderCmds,&cmd);
+}
+
+/*
+	Consumer side
+*/
+static int Apply_Tile(const RenderCmd* cmd){
+	int i;
+	for(i = 0; i < LayerSize;i++){
+		Quad* qd = &Layer[i];
+		if(qd->verts[0].p.x != cmd->f[0] || qd->verts[0].p.y != cmd->f[1])
+			continue;
+		qd->mat.texture = cmd->texture;
+		qd->mat.bumpmap = cmd->bumpmap;
+		qd->mat.bumpmapped = cmd->bumpmap != NULL;
+		return 1;
+	}
+	return 0;
+}
+
+static int Apply(const RenderCmd* cmd){
+	Light* l = cmd->index >= 0 && cmd->index < MAX_LIGHTS ? &Lights[cmd->index] : NULL;
+
+	switch(cmd->type){
+	case CMD_LIGHT_POS:
+	case CMD_LIGHT_MOVE:
+		if(l == NULL)
+			break;
+		if(cmd->type == CMD_LIGHT_POS)
+			l->x = l->y = l->z = 0.0f;
+		l->x += cmd->f[0];
+		l->y += cmd->f[1];
+		l->z += cmd->f[2];
+		LightsDirty |= 1u << cmd->index;
+		break;
+	case CMD_LIGHT_COLOR:
+		if(l == NULL)
+			break;
+		l->r = cmd->f[0];
+		l->g = cmd->f[1];
+		l->b = cmd->f[2];
+		l->a = cmd->f[3];
+		Light_Anim_Rebase(cmd->index);
+		break;
+	case CMD_LIGHT_ATTEN:
+		if(l == NULL)
+			break;
+		l->ac = cmd->f[0];
+		l->ab = cmd->f[1];
+		l->aa = cmd->f[2];
+		l->radius = cmd->f[3];
+		LightsDirty |= 1u << cmd->index;
+		break;
+	case CMD_LIGHT_COUNT:
+		LIGHTS = MAX(MIN(cmd->index,MAX_LIGHTS),0);
+		break;
+	case CMD_SHADOWS:
+		SHADOWS = cmd->index != 0;
+		break;
+	case CMD_AMBIENT:
+		Ambient_Set(cmd->f[0],cmd->f[1],cmd->f[2]);
+		break;
+	case CMD_TILE_MATERIAL:
+		return Apply_Tile(cmd);
+	}
+	return 0;
+}
+
+/*
+	Applies everything pushed so far, the layer is only resorted once
+	however many tiles changed. Returns the number of commands
+*/
+int Cmd_Drain(CmdRing* ring){
+	Uint32 head = __atomic_load_n(&ring->head,__ATOMIC_ACQUIRE);
+	Uint32 tail = ring->tail;
+	int n = 0,resort = 0;
+
+	while(tail != head){
+		resort |= Apply(&ring->cmds[tail & (CMD_RING_SIZE - 1)]);
+		tail++;
+		n++;
+	}
+	__atomic_store_n(&ring->tail,tail,__ATOMIC_RELEASE);
+	ring->drained += n;
+	if(resort)
+		Sort_Layer();
+	return n;
+}
@@ -0,0 +1,61 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include "light.h"
+
+/*
+	Render command ring
+	- Game logic pushes commands, the render thread drains them all at
+	  the start of a frame, so lights and tiles only ever change
+	  between frames
+	- Single producer, single consumer: each side only writes its own
+	  index, published with release/acquire so a command is complete
+	  before the other side can see it. No locks
+	- A full ring drops the command and counts it, the game thread
+	  never waits on the renderer
+*/
+
+#define CMD_RING_SIZE 256	// power of two
+
+enum {
+	CMD_LIGHT_POS = 0,	// light, x y z
+	CMD_LIGHT_MOVE,	// light, dx dy dz
+	CMD_LIGHT_COLOR,	// light, r g b a
+	CMD_LIGHT_ATTEN,	// light, ac ab aa radius
+	CMD_LIGHT_COUNT,	// count, lights past it are switched off
+	CMD_TILE_MATERIAL,	// tile at x y, texture bumpmap
+	CMD_SHADOWS,	// on
+	CMD_AMBIENT	// r g b
+};
+
+typedef struct {
+	Uint32 type;
+	int index;
+	float f[4];
+	Texture* texture;
+	Texture* bumpmap;
+}RenderCmd;
+
+typedef struct {
+	RenderCmd cmds[CMD_RING_SIZE];
+	Uint32 head __attribute__((aligned(32)));	// next write, producer only
+	Uint32 dropped;
+	Uint32 tail __attribute__((aligned(32)));	// next read, consumer only
+	Uint32 drained;
+}CmdRing;
+
+extern CmdRing RenderCmds;
+
+int Cmd_Push(CmdRing* ring,const RenderCmd* cmd);
+int Cmd_Drain(CmdRing* ring);
+
+int Cmd_Light_Move(int light,float dx,float dy,float dz);
+int Cmd_Light_Pos(int light,float x,float y,float z);
+int Cmd_Light_Color(int light,float r,float g,float b,float a);
+int Cmd_Light_Atten(int light,float ac,float ab,float aa,float radius);
+int Cmd_Light_Count(int count);
+int Cmd_Tile_Material(float x,float y,Texture* texture,Texture* bumpmap);
+int Cmd_Shadows(int on);
+int Cmd_Ambient(float r,float g,float b);
+
+#endif
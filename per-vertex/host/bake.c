@@ -0,0 +1,261 @@
+/*
+	Offline vertex colour baker
+	- Lights a DSCN scene's layer with its static lights (every light
+	  with -a) and writes the DCOL file Load_Bake() reads back
+	- Vertices are lit in chunks on every core through jobs.c, using
+	  the SoA kernels from light_soa.c
+	- -s adds occluder shadows. There are no bounces, every tile of a
+	  layer lies in the same plane so none of them sees another
+	- The bake has one colour per layer vertex, so the layer has to be
+	  built the way the target builds it. Scenes with more tiles than
+	  the Dreamcast layer holds (LAYER_SIZE, -l for other targets) are
+	  refused instead of baked for a layer the target never makes
+
+	make -f Makefile.host bake
+	_host/bake [-j threads] [-l max quads] [-s] [-a] scene.scn out.col
+*/
+
+#include <kos.h>
+#include <time.h>
+#include "../light.h"
+#include "../shadow.h"
+#include "../texture.h"
+#include "../scene.h"
+#include "../jobs.h"
+#include "light_soa.h"
+
+#define BAKE_GRAIN 256	// vertices per job chunk
+
+enum {
+	B_X,B_Y,B_Z,
+	B_NX,B_NY,B_NZ,
+	B_R,B_G,B_B,	// total
+	B_PR,B_PG,B_PB,	// what the last pass added
+	B_BUFFERS
+};
+
+static float* Buf[B_BUFFERS];
+static Uint8* Reach;
+static int VertCount;
+
+static Light* Lit;	// lights for the pass being run
+static int LitCount;
+static int Shadows = 0;
+
+static LightSoA View(int first,int end){
+	LightSoA v;
+	v.x = Buf[B_X] + first;
+	v.y = Buf[B_Y] + first;
+	v.z = Buf[B_Z] + first;
+	v.nx = Buf[B_NX] + first;
+	v.ny = Buf[B_NY] + first;
+	v.nz = Buf[B_NZ] + first;
+	v.r = Buf[B_PR] + first;
+	v.g = Buf[B_PG] + first;
+	v.b = Buf[B_PB] + first;
+	v.reach = NULL;
+	v.count = end - first;
+	return v;
+}
+
+/*
+	Lights the chunk into the pass buffers, lights whose radius misses
+	the chunk's bounds entirely are skipped
+*/
+static void Light_Job(void* arg,int first,int end){
+	LightSoA v = View(first,end);
+	float x0 = Buf[B_X][first],x1 = x0,y0 = Buf[B_Y][first],y1 = y0;
+	int i,j;
+
+	for(i = first; i < end;i++){
+		x0 = MIN(x0,Buf[B_X][i]);
+		x1 = MAX(x1,Buf[B_X][i]);
+		y0 = MIN(y0,Buf[B_Y][i]);
+		y1 = MAX(y1,Buf[B_Y][i]);
+	}
+	for(j = 0; j < LitCount;j++){
+		const Light* l = &Lit[j];
+		if(l->radius > 0.0f){
+			float dx = l->x < x0 ? x0 - l->x : (l->x > x1 ? l->x - x1 : 0.0f);
+			float dy = l->y < y0 ? y0 - l->y : (l->y > y1 ? l->y - y1 : 0.0f);
+			if(dx*dx + dy*dy > l->radius*l->radius)
+				continue;
+		}
+		v.reach = NULL;
+		if(Shadows && OccluderCount){
+			for(i = first; i < end;i++)
+				Reach[i] = Light_Visible(l,Buf[B_X][i],Buf[B_Y][i]);
+			v.reach = Reach + first;
+		}
+		Light_SoA(l,&v);
+	}
+}
+
+/*
+	Adds the pass onto the total
+*/
+static void Accumulate_Job(void* arg,int first,int end){
+	int i,c;
+	for(c = 0; c < 3;c++){
+		float* total = Buf[B_R + c];
+		const float* pass = Buf[B_PR + c];
+		for(i = first; i < end;i++)
+			total[i] = MIN(total[i] + pass[i],1.0f);
+	}
+}
+
+static void Run_Pass(Light* lights,int count){
+	int c;
+	for(c = 0; c < 3;c++)
+		memset(Buf[B_PR + c],0,VertCount*sizeof(float));
+	Lit = lights;
+	LitCount = count;
+	Jobs_Parallel_For(Light_Job,NULL,VertCount,BAKE_GRAIN);
+	Jobs_Parallel_For(Accumulate_Job,NULL,VertCount,BAKE_GRAIN);
+}
+
+/*
+	Same positions and normals LightQuad() uses
+*/
+static void Gather_Vertices(){
+	int i,j,k;
+	for(i = 0; i < LayerSize;i++){
+		Quad* qd = &Layer[i];
+		Vector3 a,b,n;
+		float inv;
+
+		Transform_Quad(qd);
+		a.x = qd->verts[1].p.x - qd->verts[0].p.x;
+		a.y = qd->verts[1].p.y - qd->verts[0].p.y;
+		a.z = qd->verts[1].p.z - qd->verts[0].p.z;
+		b.x = qd->verts[2].p.x - qd->verts[0].p.x;
+		b.y = qd->verts[2].p.y - qd->verts[0].p.y;
+		b.z = qd->verts[2].p.z - qd->verts[0].p.z;
+		n.x = a.y*b.z - a.z*b.y;
+		n.y = a.z*b.x - a.x*b.z;
+		n.z = a.x*b.y - a.y*b.x;
+		inv = frsqrt(n.x*n.x + n.y*n.y + n.z*n.z);
+		for(j = 0; j < 4;j++){
+			k = i*4 + j;
+			Buf[B_X][k] = qd->verts[j].trans.x;
+			Buf[B_Y][k] = qd->verts[j].trans.y;
+			Buf[B_Z][k] = qd->verts[j].trans.z;
+			Buf[B_NX][k] = n.x*inv;
+			Buf[B_NY][k] = n.y*inv;
+			Buf[B_NZ][k] = n.z*inv;
+		}
+	}
+}
+
+static int Write_Bake(const char* fn,const Scene* s){
+	BakeHeader h;
+	BakeColor c;
+	FILE* fp = fopen(fn,"wb");
+	int i;
+
+	if(fp == NULL)
+		return -1;
+	memcpy(h.id,"DCOL",4);
+	h.version = BAKE_VERSION;
+	h.scene_hash = s->hash;
+	h.quads = LayerSize;
+	fwrite(&h,sizeof(h),1,fp);
+	for(i = 0; i < VertCount;i++){
+		c.r = Buf[B_R][i];
+		c.g = Buf[B_G][i];
+		c.b = Buf[B_B][i];
+		fwrite(&c,sizeof(c),1,fp);
+	}
+	i = ferror(fp);
+	return fclose(fp) == 0 && i == 0 ? 0 : -1;
+}
+
+static double Now_MS(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1e3 + ts.tv_nsec/1e6;
+}
+
+static void Usage(){
+	fprintf(stderr,"usage: bake [-j threads] [-l max quads] [-s] [-a] scene.scn out.col\n"
+		"	-j	threads, all cores by default\n"
+		"	-l	layer size of the target, %d (LAYER_SIZE) by default\n"
+		"	-s	occluder shadows\n"
+		"	-a	bake dynamic lights too\n",LAYER_SIZE);
+}
+
+int main(int argc,char **argv){
+	const SceneLight* sl;
+	Light* lights;
+	Scene scene;
+	int threads = 0,all = 0,limit = LAYER_SIZE;
+	int i,b,count = 0;
+	double t;
+
+	for(i = 1; i < argc && argv[i][0] == '-';i++){
+		if(strcmp(argv[i],"-j") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if(strcmp(argv[i],"-l") == 0 && i + 1 < argc)
+			limit = atoi(argv[++i]);
+		else if(strcmp(argv[i],"-s") == 0)
+			Shadows = 1;
+		else if(strcmp(argv[i],"-a") == 0)
+			all = 1;
+		else{
+			Usage();
+			return 1;
+		}
+	}
+	if(argc - i != 2){
+		Usage();
+		return 1;
+	}
+
+	Init();
+	Tex_Cache_Init(TEX_CACHE_BUDGET);
+	if(Load_Scene(argv[i],&scene) != 0){
+		fprintf(stderr,"%s: not a valid scene\n",argv[i]);
+		return 1;
+	}
+	Apply_Scene(&scene);
+	if(LayerSize > limit){
+		fprintf(stderr,"%s: %d tiles, the target layer holds %d\n",argv[i],LayerSize,limit);
+		return 1;
+	}
+	VertCount = LayerSize*4;
+	for(b = 0; b < B_BUFFERS;b++)
+		Buf[b] = calloc(VertCount + 1,sizeof(float));
+	Reach = malloc(VertCount + 1);
+	lights = malloc((scene.hdr->lights.count + 1)*sizeof(Light));
+	Gather_Vertices();
+
+	/*
+		Every light in the file, not just the MAX_LIGHTS the runtime
+		keeps in Lights[]
+	*/
+	sl = Scene_Section(&scene,lights,SceneLight);
+	for(b = 0; b < (int)scene.hdr->lights.count;b++)
+		if(all || !(sl[b].flags & SCENE_LIGHT_DYNAMIC))
+			Scene_Light(&sl[b],&lights[count++]);
+
+	/*
+		Light_SoA() picks its backend on first use, do that here
+		rather than on several job threads at once
+	*/
+	Light_SoA_Backend();
+	Jobs_Init(threads);
+	t = Now_MS();
+	Run_Pass(lights,count);
+	t = Now_MS() - t;
+
+	printf("%s: %d quads, %d lights, %d threads (%s), %.1f ms, %u steals\n",argv[i + 1],
+		LayerSize,count,Jobs_Threads(),Light_SoA_Backend(),t,(unsigned)JobsStats.steals);
+	if(Write_Bake(argv[i + 1],&scene) != 0){
+		perror(argv[i + 1]);
+		return 1;
+	}
+	Jobs_Shutdown();
+	Free_Scene(&scene);
+	Tex_Cache_Shutdown();
+	return 0;
+}
@@ -0,0 +1,546 @@
+/*
+	Host microbenchmarks for the lighting, transform and packing kernels
+	- Every case is warmed up, then timed over several repeats
+	- Output is CSV on stdout, one row per case, so runs can be diffed
+	  or fed to a spreadsheet. Items are vertices for the kernels and
+	  bytes for the texture loads, which also get MB/s
+	- heap_peak_bytes is measured, the most heap one call had live on
+	  top of what was allocated before it, zlib's included
+
+	make -f Makefile.host bench
+	_host/bench [filter]
+*/
+
+#include <kos.h>
+#include <time.h>
+#include <malloc.h>
+#include "../light.h"
+#include "../texture.h"
+#include "../scene.h"
+#include "../kernels.h"
+#include "../lod.h"
+#include "../anim.h"
+#include "../arena.h"
+#include "../jobs.h"
+#include "light_soa.h"
+
+#define WARMUP 3
+#define REPEATS 9
+#define MIN_REPEAT_NS 2000000.0	// keep every repeat above 2ms
+#define KERNEL_N 4096
+
+typedef void (*BenchFn)(void* arg);
+
+typedef struct {
+	const char* name;
+	int lights;
+	int tile;
+	int quads;
+	int items;	// vertices (or bytes) touched per call
+	int bytes;	// items are bytes, print MB/s
+}BenchCase;
+
+static Vector3 Verts[KERNEL_N];
+static Vector3 Normals[KERNEL_N];
+static Vector3 Colors[KERNEL_N];
+static Uint32 Packed[KERNEL_N];
+static float SoA[9][KERNEL_N];
+static LightSoA SoAVerts = {SoA[0],SoA[1],SoA[2],SoA[3],SoA[4],SoA[5],SoA[6],SoA[7],SoA[8],NULL,KERNEL_N};
+static const char* Filter = NULL;
+
+/*
+	The bench replaces malloc and friends, which the shared libraries
+	pick up too, and counts the bytes live through glibc's own
+	__libc_* entry points
+*/
+extern void* __libc_malloc(size_t n);
+extern void* __libc_calloc(size_t n,size_t size);
+extern void* __libc_realloc(void* p,size_t n);
+extern void __libc_free(void* p);
+
+static long HeapLive;
+static long HeapPeak;
+
+static void Heap_Add(long n){
+	long live = __atomic_add_fetch(&HeapLive,n,__ATOMIC_RELAXED);
+	long peak = __atomic_load_n(&HeapPeak,__ATOMIC_RELAXED);
+	while(live > peak && !__atomic_compare_exchange_n(&HeapPeak,&peak,live,1,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+}
+
+void* malloc(size_t n){
+	void* p = __libc_malloc(n);
+	if(p)
+		Heap_Add(malloc_usable_size(p));
+	return p;
+}
+
+void* calloc(size_t n,size_t size){
+	void* p = __libc_calloc(n,size);
+	if(p)
+		Heap_Add(malloc_usable_size(p));
+	return p;
+}
+
+void* realloc(void* p,size_t n){
+	long old = p ? (long)malloc_usable_size(p) : 0;
+	void* q = __libc_realloc(p,n);
+	if(q)
+		Heap_Add((long)malloc_usable_size(q) - old);
+	else if(n == 0)
+		Heap_Add(-old);
+	return q;
+}
+
+void free(void* p){
+	if(p)
+		Heap_Add(-(long)malloc_usable_size(p));
+	__libc_free(p);
+}
+
+static double Now_NS(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static int Cmp_Double(const void* a,const void* b){
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+/*
+	Times fn, picking an iteration count so one repeat is long enough
+	for the clock, and prints median/min/mean/stddev per item. The
+	first warmup call measures the heap peak
+*/
+static void Run_Case(const BenchCase* bc,BenchFn fn,void* arg){
+	double ns[REPEATS];
+	double t,sum = 0,var = 0,mean,med;
+	long iters = 1,n,base,heap;
+	int i;
+	char mbs[32] = "";
+
+	if(Filter && !strstr(bc->name,Filter))
+		return;
+
+	base = __atomic_load_n(&HeapLive,__ATOMIC_RELAXED);
+	__atomic_store_n(&HeapPeak,base,__ATOMIC_RELAXED);
+	fn(arg);
+	heap = __atomic_load_n(&HeapPeak,__ATOMIC_RELAXED) - base;
+	for(i = 1; i < WARMUP;i++)
+		fn(arg);
+	for(;;){
+		t = Now_NS();
+		for(n = 0; n < iters;n++)
+			fn(arg);
+		t = Now_NS() - t;
+		if(t >= MIN_REPEAT_NS || iters >= (1L << 30))
+			break;
+		iters *= 2;
+	}
+	for(i = 0; i < REPEATS;i++){
+		t = Now_NS();
+		for(n = 0; n < iters;n++)
+			fn(arg);
+		ns[i] = (Now_NS() - t) / ((double)iters * bc->items);
+		sum += ns[i];
+	}
+	mean = sum / REPEATS;
+	for(i = 0; i < REPEATS;i++)
+		var += (ns[i] - mean) * (ns[i] - mean);
+	qsort(ns,REPEATS,sizeof(double),Cmp_Double);
+	med = ns[REPEATS/2];
+	if(bc->bytes)
+		sprintf(mbs,"%.1f",1e3 / med);
+	printf("%s,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.0f,%s,%ld\n",bc->name,bc->lights,bc->tile,bc->quads,
+		bc->items,med,ns[0],mean,sqrt(var / REPEATS),1e9 / med,mbs,heap);
+	fflush(stdout);
+}
+
+/*
+	Kernels
+*/
+static void B_Normalize(void* arg){
+	int i;
+	for(i = 0; i < KERNEL_N;i++)
+		normalize(&Verts[i],&Normals[i]);
+}
+
+static void B_LightVertex(void* arg){
+	int i;
+	for(i = 0; i < KERNEL_N;i++){
+		Colors[i].x = Colors[i].y = Colors[i].z = 0.0f;
+		_lightvertex(&Verts[i],&Lights[0],&Colors[i],&Normals[i]);
+	}
+}
+
+static void B_Light_SoA(void* arg){
+	memset(SoA[6],0,3*sizeof(SoA[6]));
+	Light_SoA(&Lights[0],&SoAVerts);
+}
+
+/*
+	Lighting the layer on its own, the generic LightQuad() loop against
+	the specialised kernels (all lights are constant attenuation here,
+	the quadratic case forces the full model) and the cache, with only
+	colours changing or every light moving each frame. mixed moves one
+	light and recolours the rest, moved lets Light_Layer() pick when
+	they all move. The LOD row moves every light and caps them at 4
+*/
+static void B_Light_Generic(void* arg){
+	Light_Layer_Generic();
+}
+
+static void B_Light_Kernel(void* arg){
+	LightCache.enabled = 0;
+	Light_Layer();
+	LightCache.enabled = 1;
+}
+
+static void B_Light_Cached(void* arg){
+	Light_Layer_Cached();
+}
+
+static void B_Light_Mixed(void* arg){
+	LightsDirty = 1;
+	Light_Layer();
+}
+
+static void B_Light_Moved(void* arg){
+	LightsDirty = (1u << LIGHTS) - 1;
+	Light_Layer();
+}
+
+static void B_Light_Cached_Moved(void* arg){
+	LightsDirty = (1u << LIGHTS) - 1;
+	Light_Layer_Cached();
+}
+
+static void B_Light_LOD(void* arg){
+	LightLOD.max_lights = 4;
+	LightsDirty = (1u << LIGHTS) - 1;
+	Light_Layer_Cached();
+	LightLOD.max_lights = 0;
+}
+
+/*
+	Torches and alarms, every light flickering, pulsing or cycling its
+	colour: the animation pass and then the layer
+*/
+static float AnimTime = 0.0f;
+
+static void B_Light_Anim_Update(void* arg){
+	Light_Anim_Update(AnimTime += 1.0f / 60.0f);
+}
+
+static void B_Light_Anim(void* arg){
+	Light_Anim_Update(AnimTime += 1.0f / 60.0f);
+	Light_Layer();
+}
+
+static void B_Light_Kernel_Full(void* arg){
+	Light_Layer_Kernel(LIGHTS,ATT_QUADRATIC,0);
+}
+
+static void B_Bump_Pack(void* arg){
+	int i;
+	for(i = 0; i < KERNEL_N;i++){
+		float T = frsqrt(fipr_magnitude_sqr(Verts[i].x,Verts[i].y,Verts[i].z,0.0f))*PI2;
+		float Q = fast_atan2f(Verts[i].y,Verts[i].x);
+		Packed[i] = pvr_pack_bump(1.0f,T,Q);
+	}
+}
+
+static void B_Transform(void* arg){
+	int i = LayerSize;
+	while(i--)
+		Transform_Quad(&Layer[i]);
+}
+
+static void B_Draw_Quad(void* arg){
+	int i = LayerSize;
+	Arena_Reset(&FrameArena);
+	pvr_scene_begin();
+	pvr_list_begin(PVR_LIST_OP_POLY);
+	while(i--)
+		Draw_Quad(&Layer[i]);
+	pvr_list_finish();
+	pvr_scene_finish();
+}
+
+static void B_Draw_Layer(void* arg){
+	Arena_Reset(&FrameArena);
+	pvr_scene_begin();
+	pvr_list_begin(PVR_LIST_OP_POLY);
+	Draw_Layer();
+	pvr_list_finish();
+	pvr_scene_finish();
+}
+
+static void B_Draw_Layer_Bump(void* arg){
+	Arena_Reset(&FrameArena);
+	pvr_scene_begin();
+	pvr_list_begin(PVR_LIST_TR_POLY);
+	Draw_Layer_Bump();
+	pvr_list_finish();
+	pvr_scene_finish();
+}
+
+/*
+	Texture loading, the copy case is the old malloc + fread path
+*/
+static void B_Load_Mapped(void* arg){
+	Texture t;
+	Load_Texture((const char*)arg,&t);
+	DeleteTexture(&t);
+}
+
+static void B_Load_Streamed(void* arg){
+	Texture t;
+	Load_Texture_Streamed((const char*)arg,&t);
+	DeleteTexture(&t);
+}
+
+static void B_Load_Copy(void* arg){
+	Texture t;
+	header_t hdr;
+	FILE* fp = fopen((const char*)arg,"r");
+	void* temp;
+	if(fread(&hdr,sizeof(hdr),1,fp) != 1)
+		hdr.size = 0;
+	t.txt = pvr_mem_malloc(hdr.size);
+	temp = malloc(hdr.size);
+	if(fread(temp,hdr.size,1,fp) == 1)
+		pvr_txr_load(temp,t.txt,hdr.size);
+	free(temp);
+	fclose(fp);
+	DeleteTexture(&t);
+}
+
+static int Texture_Bytes(const char* fn){
+	header_t hdr;
+	FILE* fp = fopen(fn,"r");
+	if(fp == NULL)
+		return 0;
+	if(fread(&hdr,sizeof(hdr),1,fp) != 1)
+		hdr.size = 0;
+	fclose(fp);
+	return hdr.size;
+}
+
+/*
+	Setup
+*/
+static void Setup_Lights(int count){
+	int i;
+	LIGHTS = count;
+	for(i = 0; i < MAX_LIGHTS;i++){
+		memset(&Lights[i],0,sizeof(Light));
+		Lights[i].x = (float)((i * 173) % 640);
+		Lights[i].y = (float)((i * 97) % 480);
+		Lights[i].z = 10.0f;
+		Lights[i].w = 1.0f;
+		Lights[i].r = (i % 3) == 0 ? 5.0f : 0.0f;
+		Lights[i].g = (i % 3) == 1 ? 5.0f : 0.0f;
+		Lights[i].b = (i % 3) == 2 ? 5.0f : 0.0f;
+		Lights[i].a = 1.0f;
+		Lights[i].ac = 1.0f;
+	}
+}
+
+static void Setup_Anims(int count){
+	LightAnim a;
+	int i;
+	for(i = 0; i < count;i++){
+		memset(&a,0,sizeof(a));
+		if(i & 1){
+			a.pulse = 0.8f;
+			a.pulse_rate = 2.0f;
+			a.cycle_rate = 0.5f;
+			a.phase = i*0.1f;
+		}else{
+			a.flicker = 0.4f;
+			a.flicker_rate = 12.0f;
+		}
+		Light_Anim_Set(i,&a);
+	}
+}
+
+static void Setup_Kernel_Data(){
+	int i;
+	for(i = 0; i < KERNEL_N;i++){
+		Verts[i].x = (float)(i % 640);
+		Verts[i].y = (float)((i * 7) % 480);
+		Verts[i].z = 1.0f;
+		Verts[i].w = 1.0f;
+		Normals[i].x = 0.0f;
+		Normals[i].y = 0.0f;
+		Normals[i].z = 1.0f;
+		Normals[i].w = 1.0f;
+		SoA[0][i] = Verts[i].x;
+		SoA[1][i] = Verts[i].y;
+		SoA[2][i] = Verts[i].z;
+		SoA[3][i] = Normals[i].x;
+		SoA[4][i] = Normals[i].y;
+		SoA[5][i] = Normals[i].z;
+	}
+}
+
+static int File_Exists(const char* fn){
+	FILE* fp = fopen(fn,"r");
+	if(fp == NULL)
+		return 0;
+	fclose(fp);
+	return 1;
+}
+
+int main(int argc,char **argv){
+	static const int light_counts[] = {1,2,3,4,8};
+	static const int tiles[] = {16,32,64};
+	BenchCase bc;
+	int t,l,big,i;
+
+	if(argc > 1)
+		Filter = argv[1];
+
+	Init();
+	if(File_Exists(ROMDISK_PATH "bumpmap.raw") && File_Exists(ROMDISK_PATH "text.raw")){
+		GlobalNormal = Tex_Acquire(ROMDISK_PATH "bumpmap.raw");
+		GlobalTex = Tex_Acquire(ROMDISK_PATH "text.raw");
+	}
+	Setup_Kernel_Data();
+	Setup_Lights(1);
+
+	printf("bench,lights,tile,quads,items,ns_per_item_median,ns_per_item_min,"
+		"ns_per_item_mean,ns_per_item_stddev,items_per_sec,mb_per_sec,heap_peak_bytes\n");
+
+	bc.lights = 0;
+	bc.tile = 0;
+	bc.quads = 0;
+	bc.bytes = 0;
+	bc.items = KERNEL_N;
+	bc.name = "normalize";
+	Run_Case(&bc,B_Normalize,NULL);
+	bc.lights = 1;
+	bc.name = "lightvertex";
+	Run_Case(&bc,B_LightVertex,NULL);
+	/*
+		Every SoA backend this CPU has, the default one is put
+		back afterwards
+	*/
+	for(t = 3; t >= 0;t--){
+		static const char* backends[] = {"scalar","neon","sse2","avx2"};
+		static char names[4][32];
+		if(Light_SoA_Select(backends[t]) != 0)
+			continue;
+		sprintf(names[t],"lightvertex_soa_%s",backends[t]);
+		bc.name = names[t];
+		Run_Case(&bc,B_Light_SoA,NULL);
+	}
+	Light_SoA_Select(NULL);
+	bc.lights = 0;
+	bc.name = "atan2_pack_bump";
+	Run_Case(&bc,B_Bump_Pack,NULL);
+
+	bc.bytes = 1;
+	bc.items = Texture_Bytes(ROMDISK_PATH "text.raw");
+	if(bc.items > 0){
+		bc.name = "texture_load_mapped";
+		Run_Case(&bc,B_Load_Mapped,ROMDISK_PATH "text.raw");
+		bc.name = "texture_load_streamed";
+		Run_Case(&bc,B_Load_Streamed,ROMDISK_PATH "text.raw");
+		bc.name = "texture_load_copy";
+		Run_Case(&bc,B_Load_Copy,ROMDISK_PATH "text.raw");
+	}
+	/*
+		DTEZ copies from make -f Makefile.host zromdisk, items are
+		still the inflated bytes
+	*/
+	bc.items = Texture_Bytes("_host/romdisk/text.raw");
+	if(bc.items > 0){
+		bc.name = "texture_load_z_mapped";
+		Run_Case(&bc,B_Load_Mapped,"_host/romdisk/text.raw");
+		bc.name = "texture_load_z_streamed";
+		Run_Case(&bc,B_Load_Streamed,"_host/romdisk/text.raw");
+	}
+	bc.bytes = 0;
+
+	for(t = 0; t < (int)(sizeof(tiles)/sizeof(tiles[0]));t++){
+		for(big = 0; big < 2;big++){
+			int cols = 640 / tiles[t];
+			int count = cols * (480 / tiles[t] + 1);
+			if(big)
+				count = MAX_LAYER_SIZE;
+			Init_Layer_Size(count,big ? 64*tiles[t] : 640,tiles[t]);
+
+			bc.tile = tiles[t];
+			bc.quads = LayerSize;
+			bc.items = LayerSize * 4;
+			bc.lights = 0;
+			bc.name = "transform_quad";
+			Run_Case(&bc,B_Transform,NULL);
+			bc.name = "draw_quad";
+			Run_Case(&bc,B_Draw_Quad,NULL);
+
+			for(l = 0; l < (int)(sizeof(light_counts)/sizeof(light_counts[0]));l++){
+				if(light_counts[l] > MAX_LIGHTS)
+					continue;
+				Setup_Lights(light_counts[l]);
+				bc.lights = light_counts[l];
+				bc.name = "draw_layer";
+				Run_Case(&bc,B_Draw_Layer,NULL);
+				bc.name = "light_layer_generic";
+				Run_Case(&bc,B_Light_Generic,NULL);
+				bc.name = "light_layer_kernel";
+				Run_Case(&bc,B_Light_Kernel,NULL);
+				bc.name = "light_layer_kernel_quadratic";
+				Run_Case(&bc,B_Light_Kernel_Full,NULL);
+				bc.name = "light_layer_cached_recolor";
+				Run_Case(&bc,B_Light_Cached,NULL);
+				bc.name = "light_layer_cached_moved";
+				Run_Case(&bc,B_Light_Cached_Moved,NULL);
+				bc.name = "light_layer_mixed";
+				Run_Case(&bc,B_Light_Mixed,NULL);
+				bc.name = "light_layer_moved";
+				Run_Case(&bc,B_Light_Moved,NULL);
+				bc.name = "light_layer_lod_cap4";
+				Run_Case(&bc,B_Light_LOD,NULL);
+				Setup_Anims(light_counts[l]);
+				bc.name = "light_layer_anim";
+				Run_Case(&bc,B_Light_Anim,NULL);
+				if(!big && t == 0){
+					bc.items = light_counts[l];
+					bc.name = "light_anim_update";
+					Run_Case(&bc,B_Light_Anim_Update,NULL);
+					bc.items = LayerSize * 4;
+				}
+				for(i = 0; i < light_counts[l];i++)
+					Light_Anim_Stop(i);
+				bc.name = "draw_layer_bump";
+				Run_Case(&bc,B_Draw_Layer_Bump,NULL);
+			}
+			/*
+				Thread scaling on the big layers with every light,
+				the rest of the bench stays single threaded
+			*/
+			if(big){
+				static const int threads[] = {1,2,4,8};
+				static char names[4][40];
+				Setup_Lights(MAX_LIGHTS);
+				bc.lights = MAX_LIGHTS;
+				for(l = 0; l < 4;l++){
+					if(Jobs_Init(threads[l]) != threads[l])
+						continue;
+					sprintf(names[l],"draw_layer_jobs_t%d",threads[l]);
+					bc.name = names[l];
+					Run_Case(&bc,B_Draw_Layer,NULL);
+				}
+				Jobs_Init(1);
+			}
+		}
+	}
+
+	pvr_shutdown();
+	return 0;
+}
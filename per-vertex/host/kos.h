@@ -0,0 +1,294 @@
+#ifndef HOST_KOS_H
+#define HOST_KOS_H
+
+/*
+	Host stand-in for <kos.h>
+	- Only the parts of KOS the engine uses, with the same names and
+	  values so the Dreamcast code compiles unchanged on Linux
+	- The PVR calls record the display lists into RAM (see pvr_host.c)
+	  instead of feeding the tile accelerator
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stddef.h>
+
+typedef unsigned long long uint64;
+typedef unsigned int uint32;
+typedef unsigned short uint16;
+typedef unsigned char uint8;
+typedef long long int64;
+typedef int int32;
+typedef short int16;
+typedef signed char int8;
+typedef volatile uint32 vuint32;
+
+/*
+	Math helpers from dc/fmath.h
+*/
+#define F_PI 3.1415926f
+#define fsin(x) sinf(x)
+#define fcos(x) cosf(x)
+#define fsqrt(x) sqrtf(x)
+#define frsqrt(x) (1.0f / sqrtf(x))
+#define fipr(x,y,z,w,a,b,c,d) ((x)*(a) + (y)*(b) + (z)*(c) + (w)*(d))
+#define fipr_magnitude_sqr(x,y,z,w) ((x)*(x) + (y)*(y) + (z)*(z) + (w)*(w))
+
+/*
+	Matrix stack (dc/matrix.h, dc/matrix3d.h)
+*/
+typedef float matrix_t[4][4];
+extern matrix_t XMTRX;
+
+void mat_identity();
+void mat_load(matrix_t* src);
+void mat_store(matrix_t* dst);
+void mat_apply(matrix_t* src);
+
+#define mat_trans_single3_nodiv_nomod(x,y,z,x2,y2,z2) do { \
+		float _x = (x), _y = (y), _z = (z); \
+		x2 = XMTRX[0][0]*_x + XMTRX[1][0]*_y + XMTRX[2][0]*_z + XMTRX[3][0]; \
+		y2 = XMTRX[0][1]*_x + XMTRX[1][1]*_y + XMTRX[2][1]*_z + XMTRX[3][1]; \
+		z2 = XMTRX[0][2]*_x + XMTRX[1][2]*_y + XMTRX[2][2]*_z + XMTRX[3][2]; \
+	} while(0)
+
+/*
+	PVR (dc/pvr.h)
+*/
+typedef void* pvr_ptr_t;
+typedef uint32 pvr_list_t;
+
+#define PVR_LIST_OP_POLY 0
+#define PVR_LIST_OP_MOD 1
+#define PVR_LIST_TR_POLY 2
+#define PVR_LIST_TR_MOD 3
+#define PVR_LIST_PT_POLY 4
+
+#define PVR_BINSIZE_0 0
+#define PVR_BINSIZE_8 8
+#define PVR_BINSIZE_16 16
+#define PVR_BINSIZE_32 32
+
+#define PVR_CMD_POLYHDR 0x80840000
+#define PVR_CMD_VERTEX 0xe0000000
+#define PVR_CMD_VERTEX_EOL 0xf0000000
+
+#define PVR_SHADE_FLAT 0
+#define PVR_SHADE_GOURAUD 1
+#define PVR_SPECULAR_DISABLE 0
+#define PVR_SPECULAR_ENABLE 1
+#define PVR_TEXTURE_DISABLE 0
+#define PVR_TEXTURE_ENABLE 1
+#define PVR_FILTER_NONE 0
+#define PVR_FILTER_BILINEAR 2
+
+#define PVR_BLEND_ZERO 0
+#define PVR_BLEND_ONE 1
+#define PVR_BLEND_DESTCOLOR 2
+#define PVR_BLEND_INVDESTCOLOR 3
+#define PVR_BLEND_SRCALPHA 4
+#define PVR_BLEND_INVSRCALPHA 5
+#define PVR_BLEND_DESTALPHA 6
+#define PVR_BLEND_INVDESTALPHA 7
+
+#define PVR_TXRFMT_NONE 0
+#define PVR_TXRFMT_VQ_DISABLE (0 << 30)
+#define PVR_TXRFMT_VQ_ENABLE (1 << 30)
+#define PVR_TXRFMT_ARGB1555 (0 << 27)
+#define PVR_TXRFMT_RGB565 (1 << 27)
+#define PVR_TXRFMT_ARGB4444 (2 << 27)
+#define PVR_TXRFMT_YUV422 (3 << 27)
+#define PVR_TXRFMT_BUMP (4 << 27)
+#define PVR_TXRFMT_PAL4BPP (5 << 27)
+#define PVR_TXRFMT_PAL8BPP (6 << 27)
+#define PVR_TXRFMT_TWIDDLED (0 << 26)
+#define PVR_TXRFMT_NONTWIDDLED (1 << 26)
+#define PVR_TXRFMT_NOSTRIDE (0 << 21)
+#define PVR_TXRFMT_STRIDE (1 << 21)
+#define PVR_TXRFMT_8BPP_PAL(x) ((x) << 25)
+#define PVR_TXRFMT_4BPP_PAL(x) ((x) << 21)
+
+#define PVR_PAL_ARGB1555 0
+#define PVR_PAL_RGB565 1
+#define PVR_PAL_ARGB4444 2
+#define PVR_PAL_ARGB8888 3
+
+#define PVR_PACK_COLOR(a,r,g,b) ( \
+		(((uint8)((a) * 255)) << 24) | \
+		(((uint8)((r) * 255)) << 16) | \
+		(((uint8)((g) * 255)) << 8) | \
+		(((uint8)((b) * 255)) << 0))
+
+typedef struct {
+	uint32 flags;
+	float x,y,z;
+	float u,v;
+	uint32 argb,oargb;
+}pvr_vertex_t;
+
+typedef struct {
+	uint32 cmd;
+	uint32 mode1,mode2,mode3;
+	uint32 d1,d2,d3,d4;
+}pvr_poly_hdr_t;
+
+typedef struct {
+	int list_type;
+	struct {
+		int alpha,shading,fog_type,culling,color_clamp;
+		int clip_mode,modifier_mode,specular,alpha2,fog_type2,color_clamp2;
+	} gen;
+	struct {
+		int src,dst,src_enable,dst_enable,src2,dst2,src_enable2,dst_enable2;
+	} blend;
+	struct {
+		int color,uv,modifier;
+	} fmt;
+	struct {
+		int comparison,write;
+	} depth;
+	struct {
+		int enable,filter,mipmap,mipmap_bias,uv_flip,uv_clamp,alpha,env;
+		int width,height,format;
+		pvr_ptr_t base;
+	} txr,txr2;
+}pvr_poly_cxt_t;
+
+typedef struct {
+	int opb_sizes[5];
+	int vertex_buf_size;
+	int dma_enabled;
+	int fsaa_enabled;
+	int autosort_disabled;
+}pvr_init_params_t;
+
+typedef struct {
+	uint64 frame_last_time;
+	uint32 reg_last_time;
+	uint32 rnd_last_time;
+	uint32 vtx_buffer_used;
+	uint32 vtx_buffer_used_max;
+	float frame_rate;
+	uint32 frame_count;
+}pvr_stats_t;
+
+int pvr_init(pvr_init_params_t* params);
+int pvr_shutdown();
+int pvr_wait_ready();
+int pvr_scene_begin();
+int pvr_scene_finish();
+int pvr_list_begin(pvr_list_t list);
+int pvr_list_finish();
+int pvr_prim(void* data,int size);
+int pvr_get_stats(pvr_stats_t* stat);
+
+void pvr_poly_cxt_txr(pvr_poly_cxt_t* dst,pvr_list_t list,int textureformat,int tw,int th,
+	pvr_ptr_t textureaddr,int filtering);
+void pvr_poly_compile(pvr_poly_hdr_t* dst,pvr_poly_cxt_t* src);
+
+pvr_ptr_t pvr_mem_malloc(size_t size);
+void pvr_mem_free(pvr_ptr_t chunk);
+uint32 pvr_mem_available();
+void pvr_txr_load(void* src,pvr_ptr_t dst,uint32 count);
+
+void pvr_set_pal_format(int fmt);
+void pvr_set_pal_entry(uint32 idx,uint32 value);
+
+static inline uint32 pvr_pack_bump(float h,float t,float q){
+	uint8 hp = (uint8)(h * 255.0f);
+	uint8 k1 = ~hp;
+	uint8 k2 = (uint8)(hp * fsin(t));
+	uint8 k3 = (uint8)(hp * fcos(t));
+	uint8 qp = (uint8)((q / (2 * F_PI)) * 255.0f);
+	return (k1 << 24) | (k2 << 16) | (k3 << 8) | qp;
+}
+
+/*
+	Host only: what the last finished scene submitted
+*/
+#define PVR_HOST_VRAM_SIZE (8*1024*1024)
+const uint32* pvr_host_list(pvr_list_t list,uint32* bytes);
+uint8* pvr_host_vram();
+const uint32* pvr_host_palette();
+
+/*
+	Video, font and controller (dc/video.h, dc/biosfont.h, dc/maple.h)
+*/
+#define DM_640x480 1
+#define PM_RGB565 1
+#define BFONT_CODE_ISO8859_1 0
+
+extern uint16* vram_s;
+
+void vid_set_mode(int dm,int pm);
+void vid_border_color(int r,int g,int b);
+void bfont_set_encoding(int enc);
+void bfont_draw_str(void* buffer,int bufwidth,int opaque,const char* str);
+
+#define MAPLE_FUNC_CONTROLLER 0x01000000
+#define CONT_C (1<<0)
+#define CONT_B (1<<1)
+#define CONT_A (1<<2)
+#define CONT_START (1<<3)
+#define CONT_DPAD_UP (1<<4)
+#define CONT_DPAD_DOWN (1<<5)
+#define CONT_DPAD_LEFT (1<<6)
+#define CONT_DPAD_RIGHT (1<<7)
+#define CONT_Z (1<<8)
+#define CONT_Y (1<<9)
+#define CONT_X (1<<10)
+#define CONT_D (1<<11)
+
+typedef struct {
+	uint32 buttons;
+	int ltrig,rtrig;
+	int joyx,joyy;
+	int joy2x,joy2y;
+}cont_state_t;
+
+/*
+	No controllers on the host, the body never runs
+*/
+#define MAPLE_FOREACH_BEGIN(TYPE,VARTYPE,VAR) if(0){ VARTYPE* VAR = NULL; (void)VAR;
+#define MAPLE_FOREACH_END() }
+
+/*
+	Threads, mutexes and condition variables (kos/thread.h, kos/mutex.h,
+	kos/cond.h), backed by pthreads in thd_host.c
+*/
+#include <pthread.h>
+
+typedef struct kthread kthread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t condvar_t;
+
+#define MUTEX_TYPE_NORMAL 1
+
+kthread_t* thd_create(int detach,void* (*routine)(void* param),void* param);
+int thd_join(kthread_t* thd,void** value_out);
+void thd_pass();
+void thd_sleep(int ms);
+
+int mutex_init(mutex_t* m,int mtype);
+int mutex_destroy(mutex_t* m);
+int mutex_lock(mutex_t* m);
+int mutex_unlock(mutex_t* m);
+
+int cond_init(condvar_t* cv);
+int cond_destroy(condvar_t* cv);
+int cond_wait(condvar_t* cv,mutex_t* m);
+int cond_signal(condvar_t* cv);
+int cond_broadcast(condvar_t* cv);
+
+/*
+	Startup glue (kos/init.h, arch/timer.h)
+*/
+#define INIT_DEFAULT 0
+#define KOS_INIT_FLAGS(flags)
+#define KOS_INIT_ROMDISK(rd)
+
+uint64 timer_us_gettime64();
+
+#endif
@@ -0,0 +1,55 @@
+/*
+	Portable versions of the light.s routines
+	- Same argument layout and the same math, step for step, so the
+	  host build lights vertices exactly like the SH4 code
+*/
+
+#include <kos.h>
+#include "../light.h"
+
+/*
+	void normalize(void* vert1,void *vertnorm)
+	w of the result is set to 1
+*/
+void normalize(void* vert1,void *vertnorm){
+	const Vector3* v = (const Vector3*)vert1;
+	Vector3* out = (Vector3*)vertnorm;
+	float inv = frsqrt(v->x*v->x + v->y*v->y + v->z*v->z);
+	out->x = v->x * inv;
+	out->y = v->y * inv;
+	out->z = v->z * inv;
+	out->w = 1.0f;
+}
+
+/*
+	void _lightvertex(void* vert, void*light,void *outcolor,void *vert_normal)
+	outcolor += color * max(N.L,0) * (ac + ab/d + aa/d^2), clamped to 1
+*/
+void _lightvertex(void* vertex,const void* light,void * outclr,void* surfacenormal){
+	const Vector3* v = (const Vector3*)vertex;
+	const Light* l = (const Light*)light;
+	Vector3* out = (Vector3*)outclr;
+	const Vector3* n = (const Vector3*)surfacenormal;
+
+	float dx = l->x - v->x;
+	float dy = l->y - v->y;
+	float dz = l->z - v->z;
+	float inv = frsqrt(dx*dx + dy*dy + dz*dz);
+	dx *= inv;
+	dy *= inv;
+	dz *= inv;
+
+	float ndotl = dx*n->x + dy*n->y + dz*n->z;
+	if(ndotl < 0.0f)
+		ndotl = 0.0f;
+
+	float atten = (l->ab*inv + l->ac) + (inv*inv)*l->aa;
+
+	float r = out->x + l->r*ndotl*atten;
+	float g = out->y + l->g*ndotl*atten;
+	float b = out->z + l->b*ndotl*atten;
+	out->x = r < 1.0f ? r : 1.0f;
+	out->y = g < 1.0f ? g : 1.0f;
+	out->z = b < 1.0f ? b : 1.0f;
+	out->w = 1.0f;
+}
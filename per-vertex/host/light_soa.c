@@ -0,0 +1,263 @@
+/*
+	SoA versions of _lightvertex() for the host
+	- Every backend keeps the scalar operation order (1/sqrt, not an
+	  rsqrt estimate, and no fused multiply-adds) so they all light
+	  vertices the same as host/light.c
+	- Leftover vertices past the last full vector go through the
+	  scalar loop
+*/
+
+#include <kos.h>
+#include "light_soa.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOA_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SOA_NEON
+#endif
+
+static void Light_SoA_Scalar(const Light* l,LightSoA* v,int first,int end){
+	float rad2 = l->radius > 0.0f ? l->radius*l->radius : INFINITY;
+	int i;
+	for(i = first; i < end;i++){
+		float dx = l->x - v->x[i];
+		float dy = l->y - v->y[i];
+		float dz = l->z - v->z[i];
+		float inv,ndotl,atten,r,g,b;
+
+		if(dx*dx + dy*dy > rad2 || (v->reach && !v->reach[i]))
+			continue;
+		inv = frsqrt(dx*dx + dy*dy + dz*dz);
+		dx *= inv;
+		dy *= inv;
+		dz *= inv;
+		ndotl = dx*v->nx[i] + dy*v->ny[i] + dz*v->nz[i];
+		if(ndotl < 0.0f)
+			ndotl = 0.0f;
+		atten = (l->ab*inv + l->ac) + (inv*inv)*l->aa;
+		r = v->r[i] + l->r*ndotl*atten;
+		g = v->g[i] + l->g*ndotl*atten;
+		b = v->b[i] + l->b*ndotl*atten;
+		v->r[i] = r < 1.0f ? r : 1.0f;
+		v->g[i] = g < 1.0f ? g : 1.0f;
+		v->b[i] = b < 1.0f ? b : 1.0f;
+	}
+}
+
+#ifdef SOA_X86
+/*
+	Lanes whose reach byte is 0, as an all ones mask
+*/
+static inline __m128 SSE2_Unreached(const Uint8* reach){
+	int bytes;
+	__m128i m,zero = _mm_setzero_si128();
+	if(reach == NULL)
+		return _mm_setzero_ps();
+	memcpy(&bytes,reach,4);
+	m = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes),zero);
+	m = _mm_unpacklo_epi16(m,zero);
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(m,zero));
+}
+
+__attribute__((target("sse2")))
+static void Light_SoA_SSE2(const Light* l,LightSoA* v,int first,int end){
+	const __m128 lx = _mm_set1_ps(l->x),ly = _mm_set1_ps(l->y),lz = _mm_set1_ps(l->z);
+	const __m128 ac = _mm_set1_ps(l->ac),ab = _mm_set1_ps(l->ab),aa = _mm_set1_ps(l->aa);
+	const __m128 lr = _mm_set1_ps(l->r),lg = _mm_set1_ps(l->g),lb = _mm_set1_ps(l->b);
+	const __m128 rad2 = _mm_set1_ps(l->radius > 0.0f ? l->radius*l->radius : INFINITY);
+	const __m128 one = _mm_set1_ps(1.0f),zero = _mm_setzero_ps();
+	int i;
+
+	for(i = first; i + 4 <= end;i += 4){
+		__m128 dx = _mm_sub_ps(lx,_mm_loadu_ps(&v->x[i]));
+		__m128 dy = _mm_sub_ps(ly,_mm_loadu_ps(&v->y[i]));
+		__m128 dz = _mm_sub_ps(lz,_mm_loadu_ps(&v->z[i]));
+		__m128 xy = _mm_add_ps(_mm_mul_ps(dx,dx),_mm_mul_ps(dy,dy));
+		__m128 skip = _mm_or_ps(_mm_cmpgt_ps(xy,rad2),SSE2_Unreached(v->reach ? &v->reach[i] : NULL));
+		__m128 inv = _mm_div_ps(one,_mm_sqrt_ps(_mm_add_ps(xy,_mm_mul_ps(dz,dz))));
+		__m128 ndotl,atten,k,r,g,b;
+
+		dx = _mm_mul_ps(dx,inv);
+		dy = _mm_mul_ps(dy,inv);
+		dz = _mm_mul_ps(dz,inv);
+		ndotl = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,_mm_loadu_ps(&v->nx[i])),
+			_mm_mul_ps(dy,_mm_loadu_ps(&v->ny[i]))),_mm_mul_ps(dz,_mm_loadu_ps(&v->nz[i])));
+		ndotl = _mm_max_ps(ndotl,zero);
+		atten = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ab,inv),ac),_mm_mul_ps(_mm_mul_ps(inv,inv),aa));
+
+		r = _mm_loadu_ps(&v->r[i]);
+		g = _mm_loadu_ps(&v->g[i]);
+		b = _mm_loadu_ps(&v->b[i]);
+		k = _mm_min_ps(_mm_add_ps(r,_mm_mul_ps(_mm_mul_ps(lr,ndotl),atten)),one);
+		_mm_storeu_ps(&v->r[i],_mm_or_ps(_mm_and_ps(skip,r),_mm_andnot_ps(skip,k)));
+		k = _mm_min_ps(_mm_add_ps(g,_mm_mul_ps(_mm_mul_ps(lg,ndotl),atten)),one);
+		_mm_storeu_ps(&v->g[i],_mm_or_ps(_mm_and_ps(skip,g),_mm_andnot_ps(skip,k)));
+		k = _mm_min_ps(_mm_add_ps(b,_mm_mul_ps(_mm_mul_ps(lb,ndotl),atten)),one);
+		_mm_storeu_ps(&v->b[i],_mm_or_ps(_mm_and_ps(skip,b),_mm_andnot_ps(skip,k)));
+	}
+	Light_SoA_Scalar(l,v,i,end);
+}
+
+__attribute__((target("avx2")))
+static void Light_SoA_AVX2(const Light* l,LightSoA* v,int first,int end){
+	const __m256 lx = _mm256_set1_ps(l->x),ly = _mm256_set1_ps(l->y),lz = _mm256_set1_ps(l->z);
+	const __m256 ac = _mm256_set1_ps(l->ac),ab = _mm256_set1_ps(l->ab),aa = _mm256_set1_ps(l->aa);
+	const __m256 lr = _mm256_set1_ps(l->r),lg = _mm256_set1_ps(l->g),lb = _mm256_set1_ps(l->b);
+	const __m256 rad2 = _mm256_set1_ps(l->radius > 0.0f ? l->radius*l->radius : INFINITY);
+	const __m256 one = _mm256_set1_ps(1.0f),zero = _mm256_setzero_ps();
+	int i;
+
+	for(i = first; i + 8 <= end;i += 8){
+		__m256 dx = _mm256_sub_ps(lx,_mm256_loadu_ps(&v->x[i]));
+		__m256 dy = _mm256_sub_ps(ly,_mm256_loadu_ps(&v->y[i]));
+		__m256 dz = _mm256_sub_ps(lz,_mm256_loadu_ps(&v->z[i]));
+		__m256 xy = _mm256_add_ps(_mm256_mul_ps(dx,dx),_mm256_mul_ps(dy,dy));
+		__m256 keep = _mm256_cmp_ps(xy,rad2,_CMP_LE_OQ);
+		__m256 inv = _mm256_div_ps(one,_mm256_sqrt_ps(_mm256_add_ps(xy,_mm256_mul_ps(dz,dz))));
+		__m256 ndotl,atten,r,g,b;
+
+		if(v->reach){
+			__m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&v->reach[i]));
+			m = _mm256_cmpeq_epi32(m,_mm256_setzero_si256());
+			keep = _mm256_andnot_ps(_mm256_castsi256_ps(m),keep);
+		}
+		dx = _mm256_mul_ps(dx,inv);
+		dy = _mm256_mul_ps(dy,inv);
+		dz = _mm256_mul_ps(dz,inv);
+		ndotl = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx,_mm256_loadu_ps(&v->nx[i])),
+			_mm256_mul_ps(dy,_mm256_loadu_ps(&v->ny[i]))),_mm256_mul_ps(dz,_mm256_loadu_ps(&v->nz[i])));
+		ndotl = _mm256_max_ps(ndotl,zero);
+		atten = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ab,inv),ac),_mm256_mul_ps(_mm256_mul_ps(inv,inv),aa));
+
+		r = _mm256_loadu_ps(&v->r[i]);
+		g = _mm256_loadu_ps(&v->g[i]);
+		b = _mm256_loadu_ps(&v->b[i]);
+		_mm256_storeu_ps(&v->r[i],_mm256_blendv_ps(r,
+			_mm256_min_ps(_mm256_add_ps(r,_mm256_mul_ps(_mm256_mul_ps(lr,ndotl),atten)),one),keep));
+		_mm256_storeu_ps(&v->g[i],_mm256_blendv_ps(g,
+			_mm256_min_ps(_mm256_add_ps(g,_mm256_mul_ps(_mm256_mul_ps(lg,ndotl),atten)),one),keep));
+		_mm256_storeu_ps(&v->b[i],_mm256_blendv_ps(b,
+			_mm256_min_ps(_mm256_add_ps(b,_mm256_mul_ps(_mm256_mul_ps(lb,ndotl),atten)),one),keep));
+	}
+	Light_SoA_Scalar(l,v,i,end);
+}
+#endif
+
+#ifdef SOA_NEON
+static void Light_SoA_NEON(const Light* l,LightSoA* v,int first,int end){
+	const float32x4_t lx = vdupq_n_f32(l->x),ly = vdupq_n_f32(l->y),lz = vdupq_n_f32(l->z);
+	const float32x4_t ac = vdupq_n_f32(l->ac),ab = vdupq_n_f32(l->ab),aa = vdupq_n_f32(l->aa);
+	const float32x4_t lr = vdupq_n_f32(l->r),lg = vdupq_n_f32(l->g),lb = vdupq_n_f32(l->b);
+	const float32x4_t rad2 = vdupq_n_f32(l->radius > 0.0f ? l->radius*l->radius : INFINITY);
+	const float32x4_t one = vdupq_n_f32(1.0f),zero = vdupq_n_f32(0.0f);
+	int i;
+
+	for(i = first; i + 4 <= end;i += 4){
+		float32x4_t dx = vsubq_f32(lx,vld1q_f32(&v->x[i]));
+		float32x4_t dy = vsubq_f32(ly,vld1q_f32(&v->y[i]));
+		float32x4_t dz = vsubq_f32(lz,vld1q_f32(&v->z[i]));
+		float32x4_t xy = vaddq_f32(vmulq_f32(dx,dx),vmulq_f32(dy,dy));
+		uint32x4_t keep = vcleq_f32(xy,rad2);
+		float32x4_t inv = vdivq_f32(one,vsqrtq_f32(vaddq_f32(xy,vmulq_f32(dz,dz))));
+		float32x4_t ndotl,atten,r,g,b;
+
+		if(v->reach){
+			uint32_t m[4] = {v->reach[i],v->reach[i+1],v->reach[i+2],v->reach[i+3]};
+			keep = vandq_u32(keep,vtstq_u32(vld1q_u32(m),vld1q_u32(m)));
+		}
+		dx = vmulq_f32(dx,inv);
+		dy = vmulq_f32(dy,inv);
+		dz = vmulq_f32(dz,inv);
+		ndotl = vaddq_f32(vaddq_f32(vmulq_f32(dx,vld1q_f32(&v->nx[i])),vmulq_f32(dy,vld1q_f32(&v->ny[i]))),
+			vmulq_f32(dz,vld1q_f32(&v->nz[i])));
+		ndotl = vmaxq_f32(ndotl,zero);
+		atten = vaddq_f32(vaddq_f32(vmulq_f32(ab,inv),ac),vmulq_f32(vmulq_f32(inv,inv),aa));
+
+		r = vld1q_f32(&v->r[i]);
+		g = vld1q_f32(&v->g[i]);
+		b = vld1q_f32(&v->b[i]);
+		vst1q_f32(&v->r[i],vbslq_f32(keep,vminq_f32(vaddq_f32(r,vmulq_f32(vmulq_f32(lr,ndotl),atten)),one),r));
+		vst1q_f32(&v->g[i],vbslq_f32(keep,vminq_f32(vaddq_f32(g,vmulq_f32(vmulq_f32(lg,ndotl),atten)),one),g));
+		vst1q_f32(&v->b[i],vbslq_f32(keep,vminq_f32(vaddq_f32(b,vmulq_f32(vmulq_f32(lb,ndotl),atten)),one),b));
+	}
+	Light_SoA_Scalar(l,v,i,end);
+}
+#endif
+
+/*
+	Backends, best first
+*/
+typedef struct {
+	const char* name;
+	LightSoAFn fn;
+	int width;
+}SoABackend;
+
+static const SoABackend Backends[] = {
+#ifdef SOA_X86
+	{"avx2",Light_SoA_AVX2,8},
+	{"sse2",Light_SoA_SSE2,4},
+#endif
+#ifdef SOA_NEON
+	{"neon",Light_SoA_NEON,4},
+#endif
+	{"scalar",Light_SoA_Scalar,1}
+};
+
+#define BACKENDS ((int)(sizeof(Backends)/sizeof(Backends[0])))
+
+static const SoABackend* Current = NULL;
+
+static int Supported(const SoABackend* b){
+#ifdef SOA_X86
+	__builtin_cpu_init();
+	if(b->fn == Light_SoA_AVX2)
+		return __builtin_cpu_supports("avx2");
+	if(b->fn == Light_SoA_SSE2)
+		return __builtin_cpu_supports("sse2");
+#endif
+	return 1;
+}
+
+/*
+	Picks a backend by name, or the best one the CPU has for NULL.
+	Returns -1 if the named one isn't built in or supported
+*/
+int Light_SoA_Select(const char* name){
+	int i;
+	for(i = 0; i < BACKENDS;i++){
+		if(name && strcmp(name,Backends[i].name) != 0)
+			continue;
+		if(!Supported(&Backends[i]))
+			continue;
+		Current = &Backends[i];
+		return 0;
+	}
+	return -1;
+}
+
+static void Light_SoA_Init(){
+	const char* env = getenv("LIGHT_SOA");
+	if(env == NULL || Light_SoA_Select(env) != 0)
+		Light_SoA_Select(NULL);
+}
+
+void Light_SoA(const Light* l,LightSoA* v){
+	if(Current == NULL)
+		Light_SoA_Init();
+	Current->fn(l,v,0,v->count);
+}
+
+const char* Light_SoA_Backend(){
+	if(Current == NULL)
+		Light_SoA_Init();
+	return Current->name;
+}
+
+int Light_SoA_Width(){
+	if(Current == NULL)
+		Light_SoA_Init();
+	return Current->width;
+}
@@ -0,0 +1,39 @@
+#ifndef HOST_LIGHT_SOA_H
+#define HOST_LIGHT_SOA_H
+
+#include "../light.h"
+
+/*
+	Host SIMD lighting for baking and tools
+	- Same math as _lightvertex() (host/light.c), 4 or 8 vertices at a
+	  time out of structure of arrays buffers
+	- The backend is picked on first use from what the CPU supports,
+	  LIGHT_SOA=scalar|sse2|avx2|neon in the environment overrides it.
+	  That isn't thread safe, call Light_SoA_Backend() once before
+	  lighting from job threads
+	- The light's radius is tested like Light_Reaches() does, occlusion
+	  is left to the caller through the reach array
+*/
+
+typedef struct {
+	float* x;
+	float* y;
+	float* z;
+	float* nx;
+	float* ny;
+	float* nz;
+	float* r;	// accumulated colour, clamped to 1 like FinalColor
+	float* g;
+	float* b;
+	const Uint8* reach;	// NULL, or 0 for vertices the light can't see
+	int count;
+}LightSoA;
+
+typedef void (*LightSoAFn)(const Light* l,LightSoA* v,int first,int end);
+
+void Light_SoA(const Light* l,LightSoA* v);
+int Light_SoA_Select(const char* name);
+const char* Light_SoA_Backend();
+int Light_SoA_Width();
+
+#endif
@@ -0,0 +1,288 @@
+/*
+	Host check that every lighting path matches the generic loop
+	- The layer's vertices are pushed in and out of the screen so the
+	  quads tilt and some face away from a light, the vertex colours
+	  start from different bases so the clamp to 1 is hit
+	- Light_Layer_Generic() is the reference for the specialised
+	  kernels (every light count and attenuation model, with and
+	  without a radius), the cache after a recolour and after a move,
+	  lossless LOD with a light out of reach and animated lights
+	- Every SoA backend the CPU has is held against the scalar one
+	- Prints the worst error, exits 1 past TOLERANCE
+
+	make -f Makefile.host check
+	_host/lightcheck
+*/
+
+#include <kos.h>
+#include "../light.h"
+#include "../scene.h"
+#include "../kernels.h"
+#include "../lod.h"
+#include "../anim.h"
+#include "../jobs.h"
+#include "light_soa.h"
+
+#define TOLERANCE 1e-5f
+#define CHECK_QUADS 400
+#define CHECK_TILE 32
+#define SOA_N 1021	// not a multiple of 8, the backends' scalar tails run too
+#define ANIM_FRAMES 30
+
+static Vector3 Want[MAX_LAYER_SIZE*4];
+static float Worst;
+static int Failed;
+static int Checks;
+
+/*
+	Every path starts from the colours Draw_Quad() leaves behind
+*/
+static void Reset_Colours(){
+	int i,j;
+	for(i = 0; i < LayerSize;i++){
+		for(j = 0; j < 4;j++){
+			Vertex* v = &Layer[i].verts[j];
+			v->FinalColor.x = MIN(v->c.x + Layer[i].base.x,1.0f);
+			v->FinalColor.y = MIN(v->c.y + Layer[i].base.y,1.0f);
+			v->FinalColor.z = MIN(v->c.z + Layer[i].base.z,1.0f);
+			v->FinalColor.w = 1.0f;
+		}
+	}
+}
+
+static void Reference(){
+	int i,j;
+	Reset_Colours();
+	Light_Layer_Generic();
+	for(i = 0; i < LayerSize;i++)
+		for(j = 0; j < 4;j++)
+			Want[i*4 + j] = Layer[i].verts[j].FinalColor;
+}
+
+static void Compare(const char* path,int att){
+	float worst = 0.0f;
+	int i,j;
+	for(i = 0; i < LayerSize;i++){
+		for(j = 0; j < 4;j++){
+			const Vector3* got = &Layer[i].verts[j].FinalColor;
+			const Vector3* want = &Want[i*4 + j];
+			worst = MAX(worst,fabsf(got->x - want->x));
+			worst = MAX(worst,fabsf(got->y - want->y));
+			worst = MAX(worst,fabsf(got->z - want->z));
+		}
+	}
+	Checks++;
+	Worst = MAX(Worst,worst);
+	if(worst > TOLERANCE){
+		printf("lightcheck: %s, %d lights, attenuation %d: off by %g\n",path,LIGHTS,att,worst);
+		Failed++;
+	}
+}
+
+static void Setup_Layer(){
+	int i,j;
+	Init_Layer_Size(CHECK_QUADS,640,CHECK_TILE);
+	for(i = 0; i < LayerSize;i++){
+		Quad* qd = &Layer[i];
+		for(j = 0; j < 4;j++){
+			qd->verts[j].p.z = 1.0f + (float)(((i*7 + j*13) % 11) - 5)*3.0f;
+			qd->verts[j].c.x = (float)((i + j) % 4)*0.1f;
+			qd->verts[j].c.y = 0.0f;
+			qd->verts[j].c.z = (float)(i % 3)*0.3f;
+		}
+		qd->base.x = 0.05f;
+		qd->base.y = (i % 5) == 0 ? 0.9f : 0.1f;
+		qd->base.z = 0.0f;
+		Transform_Quad(qd);
+	}
+	Light_Cache_Invalidate();
+}
+
+/*
+	Lights all over the layer and one past its far corner, the last
+	has a radius that misses it so lossless LOD culls it
+*/
+static void Setup_Lights(int count,int att){
+	int i;
+	LIGHTS = count;
+	for(i = 0; i < MAX_LIGHTS;i++){
+		Light* l = &Lights[i];
+		memset(l,0,sizeof(Light));
+		l->x = (float)((i * 173) % 640);
+		l->y = (float)((i * 97) % 640);
+		l->z = 8.0f + (float)(i % 3)*12.0f;
+		l->w = 1.0f;
+		l->r = (i % 3) == 0 ? 3.0f : 0.4f;
+		l->g = (i % 3) == 1 ? 3.0f : 0.2f;
+		l->b = (i % 3) == 2 ? 3.0f : 0.0f;
+		l->a = 1.0f;
+		l->ac = (i & 1) ? 0.25f : 1.0f;
+		if(att >= ATT_LINEAR)
+			l->ab = 20.0f + (float)i;
+		if(att == ATT_QUADRATIC)
+			l->aa = 400.0f;
+		if((i % 4) == 3)
+			l->radius = 150.0f;
+		l->flags = LIGHT_DYNAMIC;
+	}
+	if(count > 1){
+		Lights[count - 1].x = 5000.0f;
+		Lights[count - 1].y = 5000.0f;
+		Lights[count - 1].radius = 100.0f;
+	}
+	LightsDirty = (1u << MAX_LIGHTS) - 1;
+}
+
+static void Check_Paths(int count,int att){
+	Setup_Lights(count,att);
+	Reference();
+
+	Reset_Colours();
+	LightCache.enabled = 0;
+	Light_Layer();
+	LightCache.enabled = 1;
+	Compare("kernel",att);
+
+	Reset_Colours();
+	Light_Cache_Invalidate();
+	Light_Layer_Cached();
+	Compare("cached",att);
+
+	/*
+		Colour only, the cache keeps every row
+	*/
+	Lights[0].r *= 0.5f;
+	Lights[0].g += 1.0f;
+	Reference();
+	Reset_Colours();
+	Light_Layer();
+	Compare("cached after a recolour",att);
+
+	Lights[0].x += 37.0f;
+	Lights[0].z += 5.0f;
+	LightsDirty |= 1;
+	Reference();
+	Reset_Colours();
+	Light_Layer();
+	Compare("cached after a move",att);
+}
+
+/*
+	Flicker, pulse and colour cycling on every light, paths on every
+	third, through the cache like the main loop
+*/
+static void Check_Anims(){
+	LightAnim a;
+	float t = 0.0f;
+	int i,frame;
+
+	Setup_Lights(MAX_LIGHTS,ATT_QUADRATIC);
+	for(i = 0; i < LIGHTS;i++){
+		memset(&a,0,sizeof(a));
+		a.flicker = 0.4f;
+		a.flicker_rate = 12.0f;
+		a.pulse = (i & 1) ? 0.8f : 0.0f;
+		a.pulse_rate = 2.0f;
+		a.cycle_rate = 0.5f;
+		a.phase = i*0.1f;
+		if((i % 3) == 0){
+			a.keys = 3;
+			a.path_time = 0.25f;
+			a.path[0][0] = Lights[i].x;
+			a.path[0][1] = Lights[i].y;
+			a.path[0][2] = Lights[i].z;
+			a.path[1][0] = Lights[i].x + 120.0f;
+			a.path[1][1] = Lights[i].y + 40.0f;
+			a.path[1][2] = Lights[i].z;
+			a.path[2][0] = Lights[i].x;
+			a.path[2][1] = Lights[i].y + 90.0f;
+			a.path[2][2] = Lights[i].z + 10.0f;
+		}
+		Light_Anim_Set(i,&a);
+	}
+	for(frame = 0; frame < ANIM_FRAMES;frame++){
+		Light_Anim_Update(t += 1.0f / 60.0f);
+		Reference();
+		Reset_Colours();
+		Light_Layer();
+		Compare("animated",ATT_QUADRATIC);
+	}
+	Light_Anim_Reset();
+}
+
+/*
+	Every backend against scalar, half the vertices facing away and a
+	reach array that hides every fifth
+*/
+static float SoA[9][SOA_N];
+static float SoAWant[3][SOA_N];
+static Uint8 Reach[SOA_N];
+
+static void Light_SoA_All(){
+	LightSoA v = {SoA[0],SoA[1],SoA[2],SoA[3],SoA[4],SoA[5],SoA[6],SoA[7],SoA[8],Reach,SOA_N};
+	int i;
+	for(i = 0; i < SOA_N;i++){
+		SoA[6][i] = (float)(i % 7)*0.1f;
+		SoA[7][i] = 0.0f;
+		SoA[8][i] = 0.95f;
+	}
+	for(i = 0; i < LIGHTS;i++)
+		Light_SoA(&Lights[i],&v);
+}
+
+static int Check_SoA(){
+	static const char* backends[] = {"neon","sse2","avx2"};
+	float worst;
+	int i,k,c,ran = 0;
+
+	for(i = 0; i < SOA_N;i++){
+		float nz = (float)((i * 31) % 17 - 8) / 8.0f;
+		SoA[0][i] = (float)((i * 13) % 640);
+		SoA[1][i] = (float)((i * 29) % 480);
+		SoA[2][i] = (float)(i % 9);
+		SoA[3][i] = (float)((i * 5) % 3 - 1)*0.5f;
+		SoA[4][i] = 0.3f;
+		SoA[5][i] = nz;
+		Reach[i] = (i % 5) != 0;
+	}
+	Setup_Lights(MAX_LIGHTS,ATT_QUADRATIC);
+	Light_SoA_Select("scalar");
+	Light_SoA_All();
+	memcpy(SoAWant,SoA[6],sizeof(SoAWant));
+	for(k = 0; k < (int)(sizeof(backends)/sizeof(backends[0]));k++){
+		if(Light_SoA_Select(backends[k]) != 0)
+			continue;
+		Light_SoA_All();
+		worst = 0.0f;
+		for(c = 0; c < 3;c++)
+			for(i = 0; i < SOA_N;i++)
+				worst = MAX(worst,fabsf(SoA[6 + c][i] - SoAWant[c][i]));
+		Checks++;
+		ran++;
+		Worst = MAX(Worst,worst);
+		if(worst > TOLERANCE){
+			printf("lightcheck: soa %s off scalar by %g\n",backends[k],worst);
+			Failed++;
+		}
+	}
+	Light_SoA_Select(NULL);
+	return ran;
+}
+
+int main(int argc,char** argv){
+	int count,att,backends;
+
+	Init();
+	Jobs_Init(Jobs_CPU_Count());
+	Setup_Layer();
+	for(count = 1; count <= MAX_LIGHTS;count++)
+		for(att = 0; att < ATT_MODELS;att++)
+			Check_Paths(count,att);
+	Check_Anims();
+	backends = Check_SoA();
+	Jobs_Shutdown();
+
+	printf("lightcheck: %d comparisons, %d SoA backends against scalar, worst error %g, %d over %g\n",
+		Checks,backends,Worst,Failed,TOLERANCE);
+	return Failed ? 1 : 0;
+}
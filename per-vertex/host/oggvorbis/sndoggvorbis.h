@@ -0,0 +1,8 @@
+#ifndef HOST_SNDOGGVORBIS_H
+#define HOST_SNDOGGVORBIS_H
+
+/*
+	Host stand-in, the ogg streamer isn't used by the host build
+*/
+
+#endif
@@ -0,0 +1,333 @@
+/*
+	Host PVR backend
+	- Display lists are recorded into RAM, 32 bytes per pvr_prim like
+	  the tile accelerator sees them
+	- Texture memory is an 8MB array with a first-fit allocator
+	- Headers are compiled with the same bit layout KOS uses so tools
+	  reading the lists back can decode them like the hardware would
+*/
+
+#include <kos.h>
+#include <time.h>
+
+matrix_t XMTRX;
+
+static uint16 framebuffer[640*480];
+uint16* vram_s = framebuffer;
+
+/*
+	Matrix
+*/
+void mat_identity(){
+	int i,j;
+	for(i = 0; i < 4;i++)
+		for(j = 0; j < 4;j++)
+			XMTRX[i][j] = i == j ? 1.0f : 0.0f;
+}
+
+void mat_load(matrix_t* src){
+	memcpy(XMTRX,*src,sizeof(matrix_t));
+}
+
+void mat_store(matrix_t* dst){
+	memcpy(*dst,XMTRX,sizeof(matrix_t));
+}
+
+void mat_apply(matrix_t* src){
+	matrix_t r;
+	int i,j,k;
+	for(i = 0; i < 4;i++){
+		for(j = 0; j < 4;j++){
+			r[i][j] = 0.0f;
+			for(k = 0; k < 4;k++)
+				r[i][j] += (*src)[i][k] * XMTRX[k][j];
+		}
+	}
+	memcpy(XMTRX,r,sizeof(matrix_t));
+}
+
+uint64 timer_us_gettime64(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+/*
+	Display lists
+*/
+typedef struct {
+	uint32* data;
+	uint32 size;
+	uint32 cap;
+}HostList;
+
+static HostList Lists[5];
+static int CurrentList = -1;
+static uint64 LastFrame = 0;
+static pvr_stats_t Stats;
+
+int pvr_init(pvr_init_params_t* params){
+	int i;
+	for(i = 0; i < 5;i++){
+		Lists[i].size = 0;
+		Lists[i].cap = params->vertex_buf_size;
+		Lists[i].data = malloc(Lists[i].cap);
+	}
+	memset(&Stats,0,sizeof(Stats));
+	mat_identity();
+	return 0;
+}
+
+int pvr_shutdown(){
+	int i;
+	for(i = 0; i < 5;i++){
+		free(Lists[i].data);
+		Lists[i].data = NULL;
+	}
+	return 0;
+}
+
+int pvr_wait_ready(){
+	return 0;
+}
+
+int pvr_scene_begin(){
+	int i;
+	for(i = 0; i < 5;i++)
+		Lists[i].size = 0;
+	return 0;
+}
+
+int pvr_list_begin(pvr_list_t list){
+	CurrentList = list;
+	return 0;
+}
+
+int pvr_list_finish(){
+	CurrentList = -1;
+	return 0;
+}
+
+int pvr_scene_finish(){
+	uint64 now = timer_us_gettime64();
+	uint32 used = 0;
+	int i;
+	for(i = 0; i < 5;i++)
+		used += Lists[i].size;
+	if(LastFrame != 0 && now != LastFrame)
+		Stats.frame_rate = 1000000.0f / (float)(now - LastFrame);
+	Stats.frame_last_time = now - LastFrame;
+	Stats.vtx_buffer_used = used;
+	if(used > Stats.vtx_buffer_used_max)
+		Stats.vtx_buffer_used_max = used;
+	Stats.frame_count++;
+	LastFrame = now;
+	return 0;
+}
+
+int pvr_prim(void* data,int size){
+	HostList* l;
+	if(CurrentList < 0)
+		return -1;
+	l = &Lists[CurrentList];
+	if(l->size + size > l->cap){
+		while(l->size + size > l->cap)
+			l->cap *= 2;
+		l->data = realloc(l->data,l->cap);
+	}
+	memcpy((uint8*)l->data + l->size,data,size);
+	l->size += size;
+	return 0;
+}
+
+int pvr_get_stats(pvr_stats_t* stat){
+	*stat = Stats;
+	return 0;
+}
+
+const uint32* pvr_host_list(pvr_list_t list,uint32* bytes){
+	*bytes = Lists[list].size;
+	return Lists[list].data;
+}
+
+/*
+	Header compiling, same defaults and bit positions as KOS
+*/
+void pvr_poly_cxt_txr(pvr_poly_cxt_t* dst,pvr_list_t list,int textureformat,int tw,int th,
+	pvr_ptr_t textureaddr,int filtering){
+	int alpha = list != PVR_LIST_OP_POLY;
+	memset(dst,0,sizeof(pvr_poly_cxt_t));
+	dst->list_type = list;
+	dst->gen.shading = PVR_SHADE_GOURAUD;
+	dst->gen.culling = 2;
+	dst->gen.alpha = alpha;
+	dst->depth.comparison = 6;
+	dst->depth.write = 1;
+	dst->blend.src = alpha ? PVR_BLEND_SRCALPHA : PVR_BLEND_ONE;
+	dst->blend.dst = alpha ? PVR_BLEND_INVSRCALPHA : PVR_BLEND_ZERO;
+	dst->txr.enable = PVR_TEXTURE_ENABLE;
+	dst->txr.alpha = alpha;
+	dst->txr.env = alpha ? 3 : 1;
+	dst->txr.filter = filtering;
+	dst->txr.width = tw;
+	dst->txr.height = th;
+	dst->txr.format = textureformat;
+	dst->txr.base = textureaddr;
+}
+
+static uint32 Size_Bits(int s){
+	uint32 b = 0;
+	s >>= 3;
+	while(s > 1 && b < 7){
+		s >>= 1;
+		b++;
+	}
+	return b;
+}
+
+void pvr_poly_compile(pvr_poly_hdr_t* dst,pvr_poly_cxt_t* src){
+	dst->cmd = PVR_CMD_POLYHDR;
+	if(src->txr.enable)
+		dst->cmd |= 8;
+	dst->cmd |= (src->list_type << 24) & 0x07000000;
+	dst->cmd |= (src->fmt.color << 4) & 0x30;
+	dst->cmd |= (src->gen.shading << 1) & 0x02;
+	dst->cmd |= (src->fmt.uv << 0) & 0x01;
+	dst->cmd |= (src->gen.specular << 2) & 0x04;
+
+	dst->mode1 = (src->depth.comparison << 29) & 0xe0000000;
+	dst->mode1 |= (src->gen.culling << 27) & 0x18000000;
+	dst->mode1 |= (src->depth.write << 26) & 0x04000000;
+	dst->mode1 |= (src->txr.enable << 25) & 0x02000000;
+
+	dst->mode2 = (src->blend.src << 29) & 0xe0000000;
+	dst->mode2 |= (src->blend.dst << 26) & 0x1c000000;
+	dst->mode2 |= (src->gen.alpha << 20) & 0x00100000;
+	dst->mode3 = 0;
+	if(src->txr.enable){
+		dst->mode2 |= (src->txr.alpha << 19) & 0x00080000;
+		dst->mode2 |= (src->txr.filter << 13) & 0x00006000;
+		dst->mode2 |= (src->txr.env << 6) & 0x000000c0;
+		dst->mode2 |= Size_Bits(src->txr.width) << 3;
+		dst->mode2 |= Size_Bits(src->txr.height);
+		dst->mode3 = src->txr.format & 0xffe00000;
+		dst->mode3 |= (((uint8*)src->txr.base - pvr_host_vram()) & 0x00fffff8) >> 3;
+	}
+	dst->d1 = dst->d2 = 0xffffffff;
+	dst->d3 = dst->d4 = 0xffffffff;
+}
+
+/*
+	Texture memory, blocks are kept sorted by offset
+*/
+#define MAX_VRAM_BLOCKS 4096
+
+typedef struct {
+	uint32 offset,size;
+	int used;
+}VramBlock;
+
+static uint8 Vram[PVR_HOST_VRAM_SIZE] __attribute__((aligned(32)));
+static VramBlock Blocks[MAX_VRAM_BLOCKS] = {{0,PVR_HOST_VRAM_SIZE,0}};
+static int BlockCount = 1;
+
+uint8* pvr_host_vram(){
+	return Vram;
+}
+
+pvr_ptr_t pvr_mem_malloc(size_t size){
+	int i;
+	size = (size + 31) & ~31;
+	for(i = 0; i < BlockCount;i++){
+		VramBlock* b = &Blocks[i];
+		if(b->used || b->size < size)
+			continue;
+		if(b->size > size && BlockCount < MAX_VRAM_BLOCKS){
+			memmove(&Blocks[i+2],&Blocks[i+1],(BlockCount - i - 1)*sizeof(VramBlock));
+			Blocks[i+1].offset = b->offset + size;
+			Blocks[i+1].size = b->size - size;
+			Blocks[i+1].used = 0;
+			b->size = size;
+			BlockCount++;
+		}
+		b->used = 1;
+		return Vram + b->offset;
+	}
+	return NULL;
+}
+
+void pvr_mem_free(pvr_ptr_t chunk){
+	uint32 off = (uint8*)chunk - Vram;
+	int i;
+	for(i = 0; i < BlockCount;i++){
+		if(Blocks[i].offset != off || !Blocks[i].used)
+			continue;
+		Blocks[i].used = 0;
+		if(i + 1 < BlockCount && !Blocks[i+1].used){
+			Blocks[i].size += Blocks[i+1].size;
+			memmove(&Blocks[i+1],&Blocks[i+2],(BlockCount - i - 2)*sizeof(VramBlock));
+			BlockCount--;
+		}
+		if(i > 0 && !Blocks[i-1].used){
+			Blocks[i-1].size += Blocks[i].size;
+			memmove(&Blocks[i],&Blocks[i+1],(BlockCount - i - 1)*sizeof(VramBlock));
+			BlockCount--;
+		}
+		return;
+	}
+}
+
+uint32 pvr_mem_available(){
+	uint32 free = 0;
+	int i;
+	for(i = 0; i < BlockCount;i++)
+		if(!Blocks[i].used)
+			free += Blocks[i].size;
+	return free;
+}
+
+void pvr_txr_load(void* src,pvr_ptr_t dst,uint32 count){
+	memcpy(dst,src,count);
+}
+
+/*
+	Palette RAM
+*/
+static uint32 Palette[1024];
+
+void pvr_set_pal_format(int fmt){
+	(void)fmt;
+}
+
+void pvr_set_pal_entry(uint32 idx,uint32 value){
+	Palette[idx & 1023] = value;
+}
+
+const uint32* pvr_host_palette(){
+	return Palette;
+}
+
+/*
+	Video and font, nothing to show on the host
+*/
+void vid_set_mode(int dm,int pm){
+	(void)dm;
+	(void)pm;
+}
+
+void vid_border_color(int r,int g,int b){
+	(void)r;
+	(void)g;
+	(void)b;
+}
+
+void bfont_set_encoding(int enc){
+	(void)enc;
+}
+
+void bfont_draw_str(void* buffer,int bufwidth,int opaque,const char* str){
+	(void)buffer;
+	(void)bufwidth;
+	(void)opaque;
+	(void)str;
+}
@@ -0,0 +1,454 @@
+/*
+	Host software reference rasterizer
+	- Walks the recorded OP then TR lists, decoding headers with the
+	  KOS/PVR bit layout and drawing triangle strips with Gouraud
+	  shading, texturing, offset color and source/dest blending
+	- Texture fetch handles twiddled, non-twiddled, VQ and paletted
+	  textures, bilinear filtering when the header asks for it
+	- Bump mapped polygons use the PVR intensity formula
+	  I = K1 + K2*sin(S) + K3*cos(S)*cos(R-Q) as their alpha
+	- No depth test or culling, the engine draws a single flat layer
+	  so submission order is enough. It's a reference, not an emulator
+*/
+
+#include <kos.h>
+#include "raster.h"
+
+typedef struct {
+	float r,g,b,a;
+}Color4;
+
+typedef struct {
+	int textured,gouraud,specular;
+	int src,dst;
+	int txralpha,env,filter;
+	int w,h;
+	uint32 fmt;
+	const uint8* base;
+}RasterState;
+
+static float Accum[RASTER_W*RASTER_H*3];
+
+/*
+	Texture fetch
+*/
+static inline uint32 Twiddle(uint32 x,uint32 y,uint32 w,uint32 h){
+	uint32 min = w < h ? w : h;
+	uint32 idx = 0,bit = 0,i;
+	for(i = 1; i < min;i <<= 1){
+		idx |= ((y & i) ? 1u : 0u) << bit;
+		idx |= ((x & i) ? 1u : 0u) << (bit + 1);
+		bit += 2;
+	}
+	if(w > h)
+		idx += (x / min) * min * min;
+	else if(h > w)
+		idx += (y / min) * min * min;
+	return idx;
+}
+
+static inline Color4 Unpack_ARGB8888(uint32 c){
+	Color4 o;
+	o.a = ((c >> 24) & 0xff) / 255.0f;
+	o.r = ((c >> 16) & 0xff) / 255.0f;
+	o.g = ((c >> 8) & 0xff) / 255.0f;
+	o.b = (c & 0xff) / 255.0f;
+	return o;
+}
+
+static Color4 Unpack_16(uint16 t,int pf){
+	Color4 o;
+	switch(pf){
+	case 0:	// ARGB1555
+		o.a = (t >> 15) ? 1.0f : 0.0f;
+		o.r = ((t >> 10) & 31) / 31.0f;
+		o.g = ((t >> 5) & 31) / 31.0f;
+		o.b = (t & 31) / 31.0f;
+		break;
+	case 2:	// ARGB4444
+		o.a = ((t >> 12) & 15) / 15.0f;
+		o.r = ((t >> 8) & 15) / 15.0f;
+		o.g = ((t >> 4) & 15) / 15.0f;
+		o.b = (t & 15) / 15.0f;
+		break;
+	case 4:	// BUMP, S (elevation) high byte, R (rotation) low byte
+		o.r = (t >> 8) / 255.0f;
+		o.g = (t & 0xff) / 255.0f;
+		o.b = 0.0f;
+		o.a = 1.0f;
+		break;
+	default:	// RGB565, YUV422 is shown as RGB565
+		o.a = 1.0f;
+		o.r = ((t >> 11) & 31) / 31.0f;
+		o.g = ((t >> 5) & 63) / 63.0f;
+		o.b = (t & 31) / 31.0f;
+		break;
+	}
+	return o;
+}
+
+static Color4 Texel(const RasterState* st,int x,int y){
+	int pf = (st->fmt >> 27) & 7;
+	int vq = (st->fmt >> 30) & 1;
+	int twiddled = vq || pf >= 5 || !((st->fmt >> 26) & 1);
+	const uint32* pal = pvr_host_palette();
+	uint32 idx;
+
+	x &= st->w - 1;
+	y &= st->h - 1;
+	if(vq){
+		const uint16* book = (const uint16*)st->base;
+		uint8 code = st->base[2048 + Twiddle(x >> 1,y >> 1,st->w >> 1,st->h >> 1)];
+		return Unpack_16(book[code*4 + (((x & 1) << 1) | (y & 1))],pf);
+	}
+	idx = twiddled ? Twiddle(x,y,st->w,st->h) : (uint32)(y*st->w + x);
+	if(pf == 5){
+		uint8 b = st->base[idx >> 1];
+		uint32 n = (idx & 1) ? (b >> 4) : (b & 15);
+		return Unpack_ARGB8888(pal[(((st->fmt >> 21) & 63) * 16 + n) & 1023]);
+	}
+	if(pf == 6)
+		return Unpack_ARGB8888(pal[(((st->fmt >> 25) & 3) * 256 + st->base[idx]) & 1023]);
+	return Unpack_16(((const uint16*)st->base)[idx],pf);
+}
+
+static Color4 Sample(const RasterState* st,float u,float v){
+	Color4 c00,c10,c01,c11,o;
+	float fx,fy;
+	int x,y;
+	if(st->filter == PVR_FILTER_NONE)
+		return Texel(st,(int)floorf(u*st->w),(int)floorf(v*st->h));
+	u = u*st->w - 0.5f;
+	v = v*st->h - 0.5f;
+	x = (int)floorf(u);
+	y = (int)floorf(v);
+	fx = u - x;
+	fy = v - y;
+	c00 = Texel(st,x,y);
+	c10 = Texel(st,x+1,y);
+	c01 = Texel(st,x,y+1);
+	c11 = Texel(st,x+1,y+1);
+#define BILERP(ch) (((c00.ch*(1-fx) + c10.ch*fx)*(1-fy)) + ((c01.ch*(1-fx) + c11.ch*fx)*fy))
+	o.r = BILERP(r);
+	o.g = BILERP(g);
+	o.b = BILERP(b);
+	o.a = BILERP(a);
+#undef BILERP
+	return o;
+}
+
+/*
+	Shading and blending
+*/
+static float Blend_Factor(int mode,const Color4* s,const float* d,int ch){
+	switch(mode){
+	case PVR_BLEND_ZERO: return 0.0f;
+	case PVR_BLEND_ONE: return 1.0f;
+	case PVR_BLEND_DESTCOLOR: return d[ch];
+	case PVR_BLEND_INVDESTCOLOR: return 1.0f - d[ch];
+	case PVR_BLEND_SRCALPHA: return s->a;
+	case PVR_BLEND_INVSRCALPHA: return 1.0f - s->a;
+	case PVR_BLEND_DESTALPHA: return 1.0f;
+	case PVR_BLEND_INVDESTALPHA: return 0.0f;
+	}
+	return 1.0f;
+}
+
+static inline float Clamp01(float v){
+	return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+static void Shade_Pixel(const RasterState* st,int px,int py,Color4 col,float u,float v,uint32 oargb){
+	float* d = &Accum[(py*RASTER_W + px)*3];
+	Color4 s = col;
+	int ch;
+
+	if(st->textured){
+		Color4 t = Sample(st,u,v);
+		if(((st->fmt >> 27) & 7) == 4){
+			float k1 = ((oargb >> 24) & 0xff) / 255.0f;
+			float k2 = ((oargb >> 16) & 0xff) / 255.0f;
+			float k3 = ((oargb >> 8) & 0xff) / 255.0f;
+			float q = (oargb & 0xff) / 255.0f * 2.0f * F_PI;
+			float sel = t.r * F_PI * 0.5f;
+			float rot = t.g * 2.0f * F_PI;
+			s.a = Clamp01(k1 + k2*sinf(sel) + k3*cosf(sel)*cosf(rot - q));
+		}else{
+			if(!st->txralpha)
+				t.a = 1.0f;
+			switch(st->env){
+			case 0:	// replace
+				s = t;
+				break;
+			case 1:	// modulate
+				s.r = t.r*col.r;
+				s.g = t.g*col.g;
+				s.b = t.b*col.b;
+				s.a = t.a;
+				break;
+			case 2:	// decal
+				s.r = t.r*t.a + col.r*(1.0f - t.a);
+				s.g = t.g*t.a + col.g*(1.0f - t.a);
+				s.b = t.b*t.a + col.b*(1.0f - t.a);
+				s.a = col.a;
+				break;
+			default:	// modulate alpha
+				s.r = t.r*col.r;
+				s.g = t.g*col.g;
+				s.b = t.b*col.b;
+				s.a = t.a*col.a;
+				break;
+			}
+			if(st->specular){
+				Color4 o = Unpack_ARGB8888(oargb);
+				s.r += o.r;
+				s.g += o.g;
+				s.b += o.b;
+			}
+		}
+	}
+
+	s.r = Clamp01(s.r);
+	s.g = Clamp01(s.g);
+	s.b = Clamp01(s.b);
+	s.a = Clamp01(s.a);
+	for(ch = 0; ch < 3;ch++){
+		float sc = ch == 0 ? s.r : ch == 1 ? s.g : s.b;
+		float sf = Blend_Factor(st->src,&s,d,ch);
+		float df = Blend_Factor(st->dst,&s,d,ch);
+		d[ch] = Clamp01(sc*sf + d[ch]*df);
+	}
+}
+
+/*
+	Half-space triangle setup, the tie break on edges that pass
+	exactly through pixel centres keeps shared strip edges from being
+	drawn (and blended) twice
+*/
+static inline float Edge(const pvr_vertex_t* a,const pvr_vertex_t* b,float x,float y){
+	return (b->x - a->x)*(y - a->y) - (b->y - a->y)*(x - a->x);
+}
+
+static inline int Edge_Owns(const pvr_vertex_t* a,const pvr_vertex_t* b,float e){
+	if(e != 0.0f)
+		return e > 0.0f;
+	return (b->y - a->y) > 0.0f || ((b->y - a->y) == 0.0f && (b->x - a->x) < 0.0f);
+}
+
+static void Raster_Triangle(const RasterState* st,const pvr_vertex_t* v0,const pvr_vertex_t* v1,
+	const pvr_vertex_t* v2){
+	const pvr_vertex_t* t;
+	Color4 c[3];
+	float area = Edge(v0,v1,v2->x,v2->y);
+	int x0,y0,x1,y1,px,py;
+	uint32 oargb = v2->oargb;
+	uint32 flat = v2->argb;
+
+	if(fabsf(area) < 1e-6f)
+		return;
+	if(area < 0.0f){
+		t = v1;
+		v1 = v2;
+		v2 = t;
+		area = -area;
+	}
+	c[0] = Unpack_ARGB8888(v0->argb);
+	c[1] = Unpack_ARGB8888(v1->argb);
+	c[2] = Unpack_ARGB8888(v2->argb);
+	if(!st->gouraud)
+		c[0] = c[1] = c[2] = Unpack_ARGB8888(flat);
+
+	x0 = (int)floorf(fminf(v0->x,fminf(v1->x,v2->x)));
+	x1 = (int)ceilf(fmaxf(v0->x,fmaxf(v1->x,v2->x)));
+	y0 = (int)floorf(fminf(v0->y,fminf(v1->y,v2->y)));
+	y1 = (int)ceilf(fmaxf(v0->y,fmaxf(v1->y,v2->y)));
+	if(x0 < 0) x0 = 0;
+	if(y0 < 0) y0 = 0;
+	if(x1 > RASTER_W) x1 = RASTER_W;
+	if(y1 > RASTER_H) y1 = RASTER_H;
+
+	for(py = y0; py < y1;py++){
+		float cy = py + 0.5f;
+		for(px = x0; px < x1;px++){
+			float cx = px + 0.5f;
+			float e0 = Edge(v1,v2,cx,cy);
+			float e1 = Edge(v2,v0,cx,cy);
+			float e2 = Edge(v0,v1,cx,cy);
+			float w0,w1,w2;
+			Color4 col;
+			if(!Edge_Owns(v1,v2,e0) || !Edge_Owns(v2,v0,e1) || !Edge_Owns(v0,v1,e2))
+				continue;
+			w0 = e0 / area;
+			w1 = e1 / area;
+			w2 = 1.0f - w0 - w1;
+			col.r = c[0].r*w0 + c[1].r*w1 + c[2].r*w2;
+			col.g = c[0].g*w0 + c[1].g*w1 + c[2].g*w2;
+			col.b = c[0].b*w0 + c[1].b*w1 + c[2].b*w2;
+			col.a = c[0].a*w0 + c[1].a*w1 + c[2].a*w2;
+			Shade_Pixel(st,px,py,col,v0->u*w0 + v1->u*w1 + v2->u*w2,
+				v0->v*w0 + v1->v*w1 + v2->v*w2,oargb);
+		}
+	}
+}
+
+static void Decode_Header(const pvr_poly_hdr_t* h,RasterState* st){
+	st->textured = (h->cmd >> 3) & 1;
+	st->gouraud = (h->cmd >> 1) & 1;
+	st->specular = (h->cmd >> 2) & 1;
+	st->src = (h->mode2 >> 29) & 7;
+	st->dst = (h->mode2 >> 26) & 7;
+	st->txralpha = (h->mode2 >> 19) & 1;
+	st->filter = (h->mode2 >> 13) & 3;
+	st->env = (h->mode2 >> 6) & 3;
+	st->w = 8 << ((h->mode2 >> 3) & 7);
+	st->h = 8 << (h->mode2 & 7);
+	st->fmt = h->mode3 & 0xffe00000;
+	st->base = pvr_host_vram() + ((h->mode3 & 0x001fffff) << 3);
+}
+
+static void Raster_List(pvr_list_t list){
+	uint32 bytes,off;
+	const uint32* data = pvr_host_list(list,&bytes);
+	const pvr_vertex_t* strip[3] = {NULL,NULL,NULL};
+	RasterState st;
+	int n = 0;
+
+	memset(&st,0,sizeof(st));
+	for(off = 0; off + 32 <= bytes;off += 32){
+		const uint32* rec = data + off/4;
+		uint32 top = rec[0] >> 29;
+		if(top == 4){
+			Decode_Header((const pvr_poly_hdr_t*)rec,&st);
+			n = 0;
+		}else if(top == 7){
+			const pvr_vertex_t* v = (const pvr_vertex_t*)rec;
+			strip[0] = strip[1];
+			strip[1] = strip[2];
+			strip[2] = v;
+			if(++n >= 3)
+				Raster_Triangle(&st,strip[0],strip[1],strip[2]);
+			if(v->flags & 0x10000000)
+				n = 0;
+		}
+	}
+}
+
+void Raster_Scene(RasterImage* img){
+	int i;
+	memset(Accum,0,sizeof(Accum));
+	Raster_List(PVR_LIST_OP_POLY);
+	Raster_List(PVR_LIST_PT_POLY);
+	Raster_List(PVR_LIST_TR_POLY);
+	img->w = RASTER_W;
+	img->h = RASTER_H;
+	img->rgb = malloc(RASTER_W*RASTER_H*3);
+	for(i = 0; i < RASTER_W*RASTER_H*3;i++)
+		img->rgb[i] = (uint8)(Accum[i]*255.0f + 0.5f);
+}
+
+void Raster_Free(RasterImage* img){
+	free(img->rgb);
+	img->rgb = NULL;
+}
+
+/*
+	Binary PPM in and out
+*/
+int Raster_Write_PPM(const RasterImage* img,const char* fn){
+	FILE* fp = fopen(fn,"wb");
+	if(fp == NULL)
+		return -1;
+	fprintf(fp,"P6\n%d %d\n255\n",img->w,img->h);
+	fwrite(img->rgb,img->w*img->h*3,1,fp);
+	fclose(fp);
+	return 0;
+}
+
+int Raster_Read_PPM(RasterImage* img,const char* fn){
+	FILE* fp = fopen(fn,"rb");
+	int maxval;
+	img->rgb = NULL;
+	if(fp == NULL)
+		return -1;
+	if(fscanf(fp,"P6 %d %d %d",&img->w,&img->h,&maxval) != 3 || maxval != 255 || fgetc(fp) == EOF){
+		fclose(fp);
+		return -1;
+	}
+	img->rgb = malloc(img->w*img->h*3);
+	if(fread(img->rgb,img->w*img->h*3,1,fp) != 1){
+		Raster_Free(img);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return 0;
+}
+
+int Raster_Compare(const RasterImage* a,const RasterImage* b,int tolerance,RasterDiff* out){
+	int i,ch;
+	double sum = 0;
+	memset(out,0,sizeof(RasterDiff));
+	if(a->w != b->w || a->h != b->h)
+		return -1;
+	for(i = 0; i < a->w*a->h;i++){
+		int worst = 0;
+		for(ch = 0; ch < 3;ch++){
+			int d = abs(a->rgb[i*3+ch] - b->rgb[i*3+ch]);
+			sum += d;
+			if(d > worst)
+				worst = d;
+		}
+		if(worst > out->max_error)
+			out->max_error = worst;
+		if(worst > tolerance)
+			out->bad_pixels++;
+	}
+	out->mean_error = sum / (a->w*a->h*3);
+	return 0;
+}
+
+int Raster_Host_Args(int argc,char** argv){
+	const char* dump = NULL;
+	const char* compare = NULL;
+	int tolerance = 2;
+	int max_bad = 0;
+	int i,ret = 0;
+	RasterImage img,ref;
+	RasterDiff diff;
+
+	for(i = 1; i < argc - 1;i++){
+		if(!strcmp(argv[i],"--dump"))
+			dump = argv[++i];
+		else if(!strcmp(argv[i],"--compare"))
+			compare = argv[++i];
+		else if(!strcmp(argv[i],"--tolerance"))
+			tolerance = atoi(argv[++i]);
+		else if(!strcmp(argv[i],"--max-bad"))
+			max_bad = atoi(argv[++i]);
+	}
+	if(dump == NULL && compare == NULL)
+		return 0;
+
+	Raster_Scene(&img);
+	if(dump && Raster_Write_PPM(&img,dump) != 0){
+		fprintf(stderr,"raster: can't write %s\n",dump);
+		ret = 2;
+	}
+	if(compare){
+		if(Raster_Read_PPM(&ref,compare) != 0){
+			fprintf(stderr,"raster: can't read %s\n",compare);
+			ret = 2;
+		}else if(Raster_Compare(&img,&ref,tolerance,&diff) != 0){
+			fprintf(stderr,"raster: %s is %dx%d, expected %dx%d\n",compare,ref.w,ref.h,img.w,img.h);
+			ret = 1;
+		}else{
+			printf("raster: max error %d, mean error %.4f, %d pixels over tolerance %d\n",
+				diff.max_error,diff.mean_error,diff.bad_pixels,tolerance);
+			if(diff.bad_pixels > max_bad)
+				ret = 1;
+		}
+		Raster_Free(&ref);
+	}
+	Raster_Free(&img);
+	return ret;
+}
@@ -0,0 +1,37 @@
+#ifndef HOST_RASTER_H
+#define HOST_RASTER_H
+
+/*
+	Host software reference rasterizer
+	- Reads back the display lists the last scene recorded through
+	  pvr_prim and draws them into a 640x480 RGB image
+	- Used to catch output changes when the hot paths get reworked
+*/
+
+#define RASTER_W 640
+#define RASTER_H 480
+
+typedef struct {
+	int w,h;
+	uint8* rgb;
+}RasterImage;
+
+typedef struct {
+	int max_error;		// biggest per-channel difference
+	double mean_error;	// average per-channel difference
+	int bad_pixels;		// pixels with a channel off by more than the tolerance
+}RasterDiff;
+
+void Raster_Scene(RasterImage* img);
+void Raster_Free(RasterImage* img);
+int Raster_Write_PPM(const RasterImage* img,const char* fn);
+int Raster_Read_PPM(RasterImage* img,const char* fn);
+int Raster_Compare(const RasterImage* a,const RasterImage* b,int tolerance,RasterDiff* out);
+
+/*
+	Handles --dump <ppm> and --compare <ppm> [--tolerance n] [--max-bad n]
+	after the main loop, returns the process exit code
+*/
+int Raster_Host_Args(int argc,char** argv);
+
+#endif
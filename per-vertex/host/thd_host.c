@@ -0,0 +1,85 @@
+/*
+	Host threads
+	- KOS thread, mutex and condvar calls mapped onto pthreads so the
+	  background loaders run the same code on both targets
+*/
+
+#include <kos.h>
+#include <sched.h>
+#include <time.h>
+
+struct kthread {
+	pthread_t id;
+	int detached;
+};
+
+kthread_t* thd_create(int detach,void* (*routine)(void* param),void* param){
+	kthread_t* t = malloc(sizeof(kthread_t));
+	if(t == NULL)
+		return NULL;
+	t->detached = detach;
+	if(pthread_create(&t->id,NULL,routine,param) != 0){
+		free(t);
+		return NULL;
+	}
+	if(detach)
+		pthread_detach(t->id);
+	return t;
+}
+
+int thd_join(kthread_t* thd,void** value_out){
+	int r;
+	if(thd == NULL || thd->detached)
+		return -1;
+	r = pthread_join(thd->id,value_out);
+	free(thd);
+	return r == 0 ? 0 : -1;
+}
+
+void thd_pass(){
+	sched_yield();
+}
+
+void thd_sleep(int ms){
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long)(ms % 1000) * 1000000;
+	nanosleep(&ts,NULL);
+}
+
+int mutex_init(mutex_t* m,int mtype){
+	(void)mtype;
+	return pthread_mutex_init(m,NULL) == 0 ? 0 : -1;
+}
+
+int mutex_destroy(mutex_t* m){
+	return pthread_mutex_destroy(m) == 0 ? 0 : -1;
+}
+
+int mutex_lock(mutex_t* m){
+	return pthread_mutex_lock(m) == 0 ? 0 : -1;
+}
+
+int mutex_unlock(mutex_t* m){
+	return pthread_mutex_unlock(m) == 0 ? 0 : -1;
+}
+
+int cond_init(condvar_t* cv){
+	return pthread_cond_init(cv,NULL) == 0 ? 0 : -1;
+}
+
+int cond_destroy(condvar_t* cv){
+	return pthread_cond_destroy(cv) == 0 ? 0 : -1;
+}
+
+int cond_wait(condvar_t* cv,mutex_t* m){
+	return pthread_cond_wait(cv,m) == 0 ? 0 : -1;
+}
+
+int cond_signal(condvar_t* cv){
+	return pthread_cond_signal(cv) == 0 ? 0 : -1;
+}
+
+int cond_broadcast(condvar_t* cv){
+	return pthread_cond_broadcast(cv) == 0 ? 0 : -1;
+}
@@ -0,0 +1,202 @@
+/*
+	Fork/join job pool, see jobs.h
+	- A thread's deque is just the range of chunk numbers it still has
+	  to run, the owner takes from the back and thieves from the front
+	- Each deque has its own lock so stealing only contends with the
+	  one thread being stolen from
+*/
+
+#include <kos.h>
+#include "jobs.h"
+
+#ifndef _arch_dreamcast
+#include <unistd.h>
+#endif
+
+typedef struct {
+	mutex_t lock;
+	int head,tail;	// chunks [head,tail) are still to run
+}JobDeque;
+
+JobStats JobsStats;
+
+static JobDeque Deques[JOB_MAX_THREADS];
+static kthread_t* Workers[JOB_MAX_THREADS];
+static int Threads = 1;	// including the caller
+static mutex_t PoolLock;
+static condvar_t WorkCond;
+static condvar_t DoneCond;
+static Uint32 Gen = 0;	// bumped for every Jobs_Parallel_For()
+static int Quit = 0;
+static int Pending = 0;	// chunks not finished yet
+
+/*
+	The current loop, set before the deques are filled
+*/
+static JobFn CurFn;
+static void* CurArg;
+static int CurCount;
+static int CurGrain;
+
+int Jobs_CPU_Count(){
+#ifdef _arch_dreamcast
+	return 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n < 1 ? 1 : (int)n;
+#endif
+}
+
+static int Take(int self,int* chunk,int* stolen){
+	JobDeque* d = &Deques[self];
+	int i;
+
+	mutex_lock(&d->lock);
+	if(d->tail > d->head){
+		*chunk = --d->tail;
+		mutex_unlock(&d->lock);
+		return 1;
+	}
+	mutex_unlock(&d->lock);
+	for(i = 1; i < Threads;i++){
+		d = &Deques[(self + i) % Threads];
+		mutex_lock(&d->lock);
+		if(d->tail > d->head){
+			*chunk = d->head++;
+			mutex_unlock(&d->lock);
+			(*stolen)++;
+			return 1;
+		}
+		mutex_unlock(&d->lock);
+	}
+	return 0;
+}
+
+static void Run(int self){
+	int chunk,first,done = 0,stolen = 0;
+	while(Take(self,&chunk,&stolen)){
+		first = chunk*CurGrain;
+		CurFn(CurArg,first,MIN(first + CurGrain,CurCount));
+		done++;
+	}
+	if(done == 0)
+		return;
+	mutex_lock(&PoolLock);
+	JobsStats.steals += stolen;
+	Pending -= done;
+	if(Pending == 0)
+		cond_broadcast(&DoneCond);
+	mutex_unlock(&PoolLock);
+}
+
+static void* Worker(void* param){
+	int self = (int)(long)param;
+	Uint32 seen = 0;
+
+	mutex_lock(&PoolLock);
+	for(;;){
+		while(Gen == seen && !Quit)
+			cond_wait(&WorkCond,&PoolLock);
+		if(Quit)
+			break;
+		seen = Gen;
+		mutex_unlock(&PoolLock);
+		Run(self);
+		mutex_lock(&PoolLock);
+	}
+	mutex_unlock(&PoolLock);
+	return NULL;
+}
+
+/*
+	threads counts the calling thread, 0 means one per CPU
+*/
+int Jobs_Init(int threads){
+	int i;
+
+	Jobs_Shutdown();
+	if(threads <= 0)
+		threads = Jobs_CPU_Count();
+	threads = MIN(threads,JOB_MAX_THREADS);
+	mutex_init(&PoolLock,MUTEX_TYPE_NORMAL);
+	cond_init(&WorkCond);
+	cond_init(&DoneCond);
+	for(i = 0; i < threads;i++){
+		mutex_init(&Deques[i].lock,MUTEX_TYPE_NORMAL);
+		Deques[i].head = Deques[i].tail = 0;
+	}
+	Quit = 0;
+	Gen = 0;
+	Threads = 1;
+	for(i = 1; i < threads;i++){
+		Workers[i] = thd_create(0,Worker,(void*)(long)i);
+		if(Workers[i] == NULL)
+			break;
+		Threads++;
+	}
+	return Threads;
+}
+
+void Jobs_Shutdown(){
+	int i;
+	if(Threads <= 1)
+		return;
+	mutex_lock(&PoolLock);
+	Quit = 1;
+	cond_broadcast(&WorkCond);
+	mutex_unlock(&PoolLock);
+	for(i = 1; i < Threads;i++)
+		thd_join(Workers[i],NULL);
+	for(i = 0; i < Threads;i++)
+		mutex_destroy(&Deques[i].lock);
+	cond_destroy(&WorkCond);
+	cond_destroy(&DoneCond);
+	mutex_destroy(&PoolLock);
+	Threads = 1;
+}
+
+int Jobs_Threads(){
+	return Threads;
+}
+
+void Jobs_Parallel_For(JobFn fn,void* arg,int count,int grain){
+	int chunks,i;
+
+	if(count <= 0)
+		return;
+	if(grain <= 0)
+		grain = MAX(count / (Threads*8),1);
+	chunks = (count + grain - 1) / grain;
+	JobsStats.runs++;
+	JobsStats.chunks += chunks;
+	if(Threads == 1 || chunks == 1){
+		for(i = 0; i < count;i += grain)
+			fn(arg,i,MIN(i + grain,count));
+		return;
+	}
+
+	mutex_lock(&PoolLock);
+	CurFn = fn;
+	CurArg = arg;
+	CurCount = count;
+	CurGrain = grain;
+	Pending = chunks;
+	/*
+		Neighbouring chunks go to the same thread
+	*/
+	for(i = 0; i < Threads;i++){
+		mutex_lock(&Deques[i].lock);
+		Deques[i].head = (int)((long)chunks*i / Threads);
+		Deques[i].tail = (int)((long)chunks*(i + 1) / Threads);
+		mutex_unlock(&Deques[i].lock);
+	}
+	Gen++;
+	cond_broadcast(&WorkCond);
+	mutex_unlock(&PoolLock);
+
+	Run(0);
+	mutex_lock(&PoolLock);
+	while(Pending > 0)
+		cond_wait(&DoneCond,&PoolLock);
+	mutex_unlock(&PoolLock);
+}
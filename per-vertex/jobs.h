@@ -0,0 +1,36 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "light.h"
+
+/*
+	Fork/join job pool
+	- Jobs_Parallel_For() splits [0,count) into chunks of "grain" (0
+	  picks one), deals them out to one deque per thread and returns
+	  once all of them ran
+	- Threads pop their own chunks from the back and steal from the
+	  front of the others when they run dry, so uneven chunks even out
+	- The calling thread works too, with no worker threads (the
+	  Dreamcast, or Jobs_Init(1)) everything runs inline in order
+	- One Jobs_Parallel_For() at a time, from one thread
+*/
+
+#define JOB_MAX_THREADS 32
+
+typedef void (*JobFn)(void* arg,int first,int end);
+
+int Jobs_Init(int threads);
+void Jobs_Shutdown();
+int Jobs_Threads();
+int Jobs_CPU_Count();
+void Jobs_Parallel_For(JobFn fn,void* arg,int count,int grain);
+
+typedef struct {
+	Uint32 runs;
+	Uint32 chunks;
+	Uint32 steals;	// chunks run by a thread they weren't dealt to
+}JobStats;
+
+extern JobStats JobsStats;
+
+#endif
@@ -0,0 +1,358 @@
+/*
+	Specialised lighting kernels, see kernels.h
+	- Light_Quads() is the template, every kernel is a call to it with
+	  constant arguments so the light loop unrolls and the unused
+	  attenuation terms and reach tests drop out
+	- The arithmetic is the same as host/light.c step for step, so a
+	  kernel lights a vertex exactly like the generic path
+	- Both paths run over the layer in TILE_ROW sized chunks through
+	  jobs.c, quads don't share anything so any split gives the same
+	  colours
+	- With the cache on, Light_Layer() keeps N.L*atten for every light
+	  and vertex and only works it out again for lights that moved, the
+	  rest just multiply their colour back in. Frames where every light
+	  moved go to the kernels
+*/
+
+#include <kos.h>
+#include "light.h"
+#include "shadow.h"
+#include "scene.h"
+#include "kernels.h"
+#include "jobs.h"
+#include "lod.h"
+
+LightKernelInfo LightKernel;
+LightCacheInfo LightCache = {1};
+
+/*
+	Lights that take part this frame, in the order the generic loop
+	goes through them
+*/
+static Light* Active[MAX_LIGHTS];
+
+static inline __attribute__((always_inline)) void Light_Vertex(const Light* l,const Vector3* n,
+	float x,float y,float z,Vector3* out,int att){
+	float dx = l->x - x;
+	float dy = l->y - y;
+	float dz = l->z - z;
+	float inv = frsqrt(dx*dx + dy*dy + dz*dz);
+	float ndotl,atten,r,g,b;
+
+	dx *= inv;
+	dy *= inv;
+	dz *= inv;
+	ndotl = dx*n->x + dy*n->y + dz*n->z;
+	if(ndotl < 0.0f)
+		ndotl = 0.0f;
+	if(att == ATT_CONSTANT)
+		atten = l->ac;
+	else if(att == ATT_LINEAR)
+		atten = l->ab*inv + l->ac;
+	else
+		atten = (l->ab*inv + l->ac) + (inv*inv)*l->aa;
+
+	r = out->x + l->r*ndotl*atten;
+	g = out->y + l->g*ndotl*atten;
+	b = out->z + l->b*ndotl*atten;
+	out->x = r < 1.0f ? r : 1.0f;
+	out->y = g < 1.0f ? g : 1.0f;
+	out->z = b < 1.0f ? b : 1.0f;
+	out->w = 1.0f;
+}
+
+static inline __attribute__((always_inline)) void Light_Quads(int first,int end,int count,int att,int reach){
+	Vector3 a,b,n;
+	int i,j,k;
+
+	i = end;
+	while(i-- > first){
+		Quad* qd = &Layer[i];
+		a.x = qd->verts[1].p.x - qd->verts[0].p.x;
+		a.y = qd->verts[1].p.y - qd->verts[0].p.y;
+		a.z = qd->verts[1].p.z - qd->verts[0].p.z;
+		b.x = qd->verts[2].p.x - qd->verts[0].p.x;
+		b.y = qd->verts[2].p.y - qd->verts[0].p.y;
+		b.z = qd->verts[2].p.z - qd->verts[0].p.z;
+		Cross(&a,&b,&n);
+		normalize(&n,&qd->surfacenormal);
+		for(j = 0; j < 4;j++){
+			Vertex* v = &qd->verts[j];
+			float x = v->trans.x,y = v->trans.y,z = v->trans.z;
+#pragma GCC unroll 8
+			for(k = 0; k < count;k++){
+				if(reach && !Light_Reaches(Active[k],x,y))
+					continue;
+				Light_Vertex(Active[k],&qd->surfacenormal,x,y,z,&v->FinalColor,att);
+			}
+		}
+	}
+}
+
+typedef void (*KernelFn)(int first,int end);
+
+#define KERNEL(n,att,reach) static void Kernel_##n##_##att##_##reach(int first,int end){ \
+	Light_Quads(first,end,n,att,reach); }
+#define KERNELS(n) \
+	KERNEL(n,0,0) KERNEL(n,0,1) KERNEL(n,1,0) KERNEL(n,1,1) KERNEL(n,2,0) KERNEL(n,2,1)
+#define KERNEL_ROW(n) \
+	{{Kernel_##n##_0_0,Kernel_##n##_0_1},{Kernel_##n##_1_0,Kernel_##n##_1_1},{Kernel_##n##_2_0,Kernel_##n##_2_1}}
+
+KERNELS(1)
+KERNELS(2)
+KERNELS(3)
+KERNELS(4)
+KERNELS(5)
+KERNELS(6)
+KERNELS(7)
+KERNELS(8)
+
+static const KernelFn Kernels[KERNEL_MAX_LIGHTS][ATT_MODELS][2] = {
+	KERNEL_ROW(1),KERNEL_ROW(2),KERNEL_ROW(3),KERNEL_ROW(4),
+	KERNEL_ROW(5),KERNEL_ROW(6),KERNEL_ROW(7),KERNEL_ROW(8)
+};
+
+/*
+	The lights the frame uses, skipping the ones already baked into
+	the vertex colours, after Light_LOD() has merged the weak ones
+*/
+static int Gather_Lights(){
+	int z = LIGHTS,count = 0;
+	while(z--){
+		if(LightsBaked && !(Lights[z].flags & LIGHT_DYNAMIC))
+			continue;
+		Active[count++] = &Lights[z];
+	}
+	return Light_LOD(Active,count);
+}
+
+static KernelFn Selected;
+
+static void Kernel_Job(void* arg,int first,int end){
+	Selected(first,end);
+}
+
+static void Run_Kernel(KernelFn fn){
+	Selected = fn;
+	Jobs_Parallel_For(Kernel_Job,NULL,LayerSize,TILE_ROW);
+}
+
+/*
+	The old loop, every light through LightQuad()
+*/
+static void Generic_Job(void* arg,int first,int end){
+	int i = end,z;
+	while(i-- > first){
+		z = LIGHTS;
+		while(z--){
+			/*
+				Static lights are already in the vertex colours
+				when there's a bake
+			*/
+			if(LightsBaked && !(Lights[z].flags & LIGHT_DYNAMIC))
+				continue;
+			LightQuad(&Layer[i],&Lights[z]);
+		}
+	}
+}
+
+void Light_Layer_Generic(){
+	LightKernel.lights = 0;
+	Jobs_Parallel_For(Generic_Job,NULL,LayerSize,TILE_ROW);
+}
+
+void Light_Layer_Kernel(int lights,int att,int reach){
+	if(Gather_Lights() != lights || lights < 1 || lights > KERNEL_MAX_LIGHTS){
+		Light_Layer_Generic();
+		return;
+	}
+	LightKernel.lights = lights;
+	LightKernel.att = att;
+	LightKernel.reach = reach;
+	Run_Kernel(Kernels[lights - 1][att][reach != 0]);
+}
+
+/*
+	N.L*atten per light slot and vertex, 0 where the light doesn't
+	reach. A row is good while its bit is in Cached and the light isn't
+	in LightsDirty. LOD's virtual lights have the slots after Lights[]
+*/
+#define CACHE_SLOTS (MAX_LIGHTS + LOD_MAX_VIRTUAL)
+
+static float Cache[CACHE_SLOTS][MAX_LAYER_SIZE*4];
+static Uint32 Cached;
+static int CachedReach;
+static Uint32 Stale;	// rows the current frame recomputes
+static float* Row[MAX_LIGHTS];	// per Active[] light, set by Run_Cached()
+static Uint8 RowStale[MAX_LIGHTS];
+
+static inline int Slot(const Light* l){
+	if(l >= Lights && l < Lights + MAX_LIGHTS)
+		return l - Lights;
+	return MAX_LIGHTS + (l - LODLights);
+}
+
+static inline float Light_Term(const Light* l,const Vector3* n,float x,float y,float z){
+	float dx = l->x - x;
+	float dy = l->y - y;
+	float dz = l->z - z;
+	float inv = frsqrt(dx*dx + dy*dy + dz*dz);
+	float ndotl;
+
+	dx *= inv;
+	dy *= inv;
+	dz *= inv;
+	ndotl = dx*n->x + dy*n->y + dz*n->z;
+	if(ndotl < 0.0f)
+		return 0.0f;
+	return ndotl*((l->ab*inv + l->ac) + (inv*inv)*l->aa);
+}
+
+static void Cached_Job(void* arg,int first,int end){
+	int count = *(int*)arg;
+	Vector3 a,b,n;
+	int i,j,k;
+
+	i = end;
+	while(i-- > first){
+		Quad* qd = &Layer[i];
+		if(Stale){
+			a.x = qd->verts[1].p.x - qd->verts[0].p.x;
+			a.y = qd->verts[1].p.y - qd->verts[0].p.y;
+			a.z = qd->verts[1].p.z - qd->verts[0].p.z;
+			b.x = qd->verts[2].p.x - qd->verts[0].p.x;
+			b.y = qd->verts[2].p.y - qd->verts[0].p.y;
+			b.z = qd->verts[2].p.z - qd->verts[0].p.z;
+			Cross(&a,&b,&n);
+			normalize(&n,&qd->surfacenormal);
+		}
+		for(j = 0; j < 4;j++){
+			Vertex* v = &qd->verts[j];
+			int at = i*4 + j;
+			for(k = 0; k < count;k++){
+				const Light* l = Active[k];
+				float s,r,g,bl;
+
+				if(RowStale[k]){
+					s = 0.0f;
+					if(Light_Reaches(l,v->trans.x,v->trans.y))
+						s = Light_Term(l,&qd->surfacenormal,v->trans.x,v->trans.y,v->trans.z);
+					Row[k][at] = s;
+				}else{
+					s = Row[k][at];
+				}
+				if(s == 0.0f)
+					continue;
+				r = v->FinalColor.x + l->r*s;
+				g = v->FinalColor.y + l->g*s;
+				bl = v->FinalColor.z + l->b*s;
+				v->FinalColor.x = r < 1.0f ? r : 1.0f;
+				v->FinalColor.y = g < 1.0f ? g : 1.0f;
+				v->FinalColor.z = bl < 1.0f ? bl : 1.0f;
+			}
+		}
+	}
+}
+
+/*
+	Recomputes the rows of lights that moved (or are new to the cache)
+	and rescales the rest, a colour change costs a multiply-add per
+	vertex
+*/
+static void Run_Cached(int count,Uint32 used){
+	int k;
+
+	Stale = used & (LightsDirty | (LightLOD.dirty << MAX_LIGHTS) | ~Cached);
+	LightsDirty &= ~used;
+	LightCache.refreshed = 0;
+	for(k = 0; k < CACHE_SLOTS;k++)
+		LightCache.refreshed += (Stale >> k) & 1;
+	LightCache.reused = count - LightCache.refreshed;
+	LightKernel.lights = 0;
+	for(k = 0; k < count;k++){
+		Row[k] = Cache[Slot(Active[k])];
+		RowStale[k] = (Stale >> Slot(Active[k])) & 1;
+	}
+	if(count)
+		Jobs_Parallel_For(Cached_Job,&count,LayerSize,TILE_ROW);
+	Cached |= Stale;
+}
+
+/*
+	Picks the kernel for the gathered lights
+*/
+static void Run_Specialised(int count){
+	int att = ATT_CONSTANT,reach = SHADOWS && OccluderCount;
+	int k;
+
+	if(count == 0)
+		return;
+	if(count > KERNEL_MAX_LIGHTS){
+		Light_Layer_Generic();
+		return;
+	}
+	for(k = 0; k < count;k++){
+		if(Active[k]->aa != 0.0f)
+			att = ATT_QUADRATIC;
+		else if(Active[k]->ab != 0.0f && att == ATT_CONSTANT)
+			att = ATT_LINEAR;
+		if(Active[k]->radius > 0.0f)
+			reach = 1;
+	}
+	LightKernel.lights = count;
+	LightKernel.att = att;
+	LightKernel.reach = reach;
+	Run_Kernel(Kernels[count - 1][att][reach]);
+}
+
+static Uint32 Used_Slots(int count){
+	Uint32 used = 0;
+	int k;
+	if(CachedReach != (SHADOWS && OccluderCount)){
+		Cached = 0;
+		CachedReach = SHADOWS && OccluderCount;
+	}
+	for(k = 0; k < count;k++)
+		used |= 1u << Slot(Active[k]);
+	return used;
+}
+
+/*
+	Always through the cache, for the bench
+*/
+void Light_Layer_Cached(){
+	int count = Gather_Lights();
+	Run_Cached(count,Used_Slots(count));
+}
+
+/*
+	The layer was rebuilt, reordered or the occluders changed
+*/
+void Light_Cache_Invalidate(){
+	Cached = 0;
+}
+
+/*
+	The cache only pays when some row can be used again. When every
+	light moved the specialised kernel is faster than filling rows
+	nobody reads, those rows are dropped and filled again the first
+	frame one of the lights stays put
+*/
+void Light_Layer(){
+	int count = Gather_Lights();
+	Uint32 used,moved;
+
+	if(LightCache.enabled){
+		used = Used_Slots(count);
+		moved = used & (LightsDirty | (LightLOD.dirty << MAX_LIGHTS));
+		if(moved != used){
+			Run_Cached(count,used);
+			return;
+		}
+		Cached &= ~used;
+		LightsDirty &= ~used;
+		LightCache.refreshed = count;
+		LightCache.reused = 0;
+	}
+	Run_Specialised(count);
+}
@@ -0,0 +1,46 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "light.h"
+
+/*
+	Lighting kernels specialised per frame
+	- One kernel per light count (1 to KERNEL_MAX_LIGHTS), attenuation
+	  model and whether the radius/occluder test is needed, generated
+	  from the same inline body so they all match _lightvertex()
+	- Light_Layer() looks at the lights once a frame and picks the
+	  kernel, more lights than that fall back to Light_Layer_Generic()
+*/
+
+#define KERNEL_MAX_LIGHTS 8
+
+enum {
+	ATT_CONSTANT = 0,	// ab and aa are 0 for every light
+	ATT_LINEAR,	// aa is 0 for every light
+	ATT_QUADRATIC,
+	ATT_MODELS
+};
+
+typedef struct {
+	int lights;	// 0 when the generic loop ran
+	int att;
+	int reach;
+}LightKernelInfo;
+
+extern LightKernelInfo LightKernel;	// what the last Light_Layer() used
+
+typedef struct {
+	int enabled;	// Light_Layer() uses the cache when a light stayed put
+	int refreshed;	// lights the last frame lit from scratch
+	int reused;	// lights it only rescaled
+}LightCacheInfo;
+
+extern LightCacheInfo LightCache;
+
+void Light_Layer();
+void Light_Layer_Generic();
+void Light_Layer_Kernel(int lights,int att,int reach);
+void Light_Layer_Cached();
+void Light_Cache_Invalidate();
+
+#endif
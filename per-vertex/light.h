@@ -2,9 +2,16 @@
 #define LIGHT_H
 
 
+#ifndef MAX_LIGHTS
 #define MAX_LIGHTS 3
+#endif
 #define TILE 64
+#define TILE_ROW (640/TILE)	// quads in a screen row, the job chunk size
 #define LAYER_SIZE (((640/TILE)*((480/TILE))) + (480/TILE))
+/* Room for bigger layers than the screen, the host build raises it */
+#ifndef MAX_LAYER_SIZE
+#define MAX_LAYER_SIZE LAYER_SIZE
+#endif
 #define PI 3.14159265f
 #define PI2 6.28318530f
 #define PI_FLOAT     3.14159265f
@@ -21,6 +28,13 @@
 #define ZFAR 255.0f
 #define PIBY2_FLOAT  1.5707963f
 
+/* Where the romdisk assets live, the host build reads them from disk */
+#ifdef _arch_dreamcast
+#define ROMDISK_PATH "/rd/"
+#else
+#define ROMDISK_PATH "romdisk/"
+#endif
+
 typedef unsigned int Uint32;
 typedef unsigned char Uint8, uint8;
 
@@ -49,20 +63,22 @@ typedef struct {
 	uint32 w,h;
 	uint32 fmt;
 	pvr_ptr_t txt;
-	Uint8 palette;
+	uint32 size;	// bytes of VRAM behind txt
+	Uint8 palette;	// palette slot + 1, 0 when there is none
 }Texture;
 
 
-typedef struct {
+typedef struct __attribute__((aligned(32))){
 	float x,y,z,w;
-}Vector3 __attribute__((aligned(32)));
+}Vector3;
 
 typedef struct {
 	Vector3 Emissive;
 	Vector3 Ambient;
 	Vector3 Diffuse;
 	Vector3 Specular;
-	Texture bumpmap;
+	Texture* texture;	// may not be resident yet, see Tex_Use()
+	Texture* bumpmap;
 	Uint8 bumpmapped;
 	float shine;
 }Material;
@@ -78,19 +94,52 @@ typedef struct{
 	Vertex verts[4];
 	Material mat;
 	Vector3 surfacenormal;
+	Vector3 base;	// emissive + ambient + hemisphere, see ambient.h
 }Quad;
 
 
 
-typedef struct{
+typedef struct __attribute__((aligned(32))){
 	float x,y,z,w;
 	float ac,ab,aa,dummy;
 	float r,g,b,a;
-}Light __attribute__((aligned(32)));
+	float radius;	// 0 = unbounded, otherwise vertices further away are skipped
+	Uint32 flags;	// LIGHT_DYNAMIC
+}Light;
+
+#define LIGHT_DYNAMIC 1	// moves at runtime, static lights never do
 
 
 
 void _lightvertex(void* vertex,const void* light,void * outclr,void* surfacenormal);
 void normalize(void* vert1,void *vertnorm);
 
+/*
+	main.c
+*/
+extern Quad Layer[MAX_LAYER_SIZE];
+extern int LayerSize;
+extern Light Lights[MAX_LIGHTS];
+extern int LIGHTS;
+extern Texture* GlobalNormal;
+extern Texture* GlobalTex;
+
+float fast_atan2f(float y,float x);
+void Cross(Vector3 *v1,Vector3* v2,Vector3 *out);
+void LightQuad(Quad *qd,Light* l);
+void Transform_Quad(Quad* qd);
+void Draw_Quad(Quad* qd);
+void Draw_Bump_Header(Texture* bump);
+void Bump_Centre(Vector3* G);
+Uint32 Bump_Param(const Quad* qd,const Vector3* G);
+void Draw_Bump(Quad *qd,Uint32 oargb);
+void Draw_Layer();
+void Draw_Layer_Bump();
+void Init_Quad_UV(Quad* qd,float x,float y,float z,float w,float h,float u0,float v0,float u1,float v1);
+void Init_Quad(Quad* qd,float x,float y,float z,float w,float h);
+void Sort_Layer();
+void Init_Layer_Size(int count,float width,float tile);
+void Init_Layer();
+void Init();
+
 #endif
@@ -0,0 +1,217 @@
+/*
+	Light level of detail, see lod.h
+*/
+
+#include <kos.h>
+#include "lod.h"
+
+LightLODInfo LightLOD = {1.0f,0};
+Light LODLights[LOD_MAX_VIRTUAL];
+static Light Prev[LOD_MAX_VIRTUAL];	// last frame's virtual lights, for dirty
+
+typedef struct {
+	int cx,cy;
+	float w;	// summed peak
+	float x,y,z;	// weighted sums
+	float ac,ab,aa;
+	float r,g,b;
+	float reach;	// furthest member edge from the cell, 0 if unbounded
+	int bounded;
+}Cluster;
+
+/*
+	Brightest channel times the attenuation at the layer's nearest
+	point, 0 when the radius misses the layer. dist gets that distance
+*/
+static float Peak(const Light* l,float x0,float y0,float x1,float y1,float z,float* dist){
+	float dx = l->x < x0 ? x0 - l->x : (l->x > x1 ? l->x - x1 : 0.0f);
+	float dy = l->y < y0 ? y0 - l->y : (l->y > y1 ? l->y - y1 : 0.0f);
+	float dz = l->z - z;
+	float d2 = dx*dx + dy*dy;
+	float inv,bright;
+
+	*dist = 1.0f;
+	if(l->radius > 0.0f && d2 > l->radius*l->radius)
+		return 0.0f;
+	d2 += dz*dz;
+	inv = d2 > 1.0f ? frsqrt(d2) : 1.0f;
+	*dist = 1.0f / inv;
+	bright = MAX(l->r,MAX(l->g,l->b));
+	if(bright <= 0.0f)
+		return 0.0f;
+	return bright*((l->ab*inv + l->ac) + (inv*inv)*l->aa);
+}
+
+static int Nearest_Cluster(const Cluster* cl,int clusters,int cx,int cy){
+	int i,d,best = 0,bd = 0x7fffffff;
+	for(i = 0; i < clusters;i++){
+		d = (cl[i].cx - cx)*(cl[i].cx - cx) + (cl[i].cy - cy)*(cl[i].cy - cy);
+		if(d < bd){
+			bd = d;
+			best = i;
+		}
+	}
+	return best;
+}
+
+/*
+	Rewrites active[] with the lights to use this frame, virtual ones
+	point into LODLights. Nothing moves when no light is merged or
+	dropped, so lossless settings light exactly like without LOD
+*/
+int Light_LOD(Light** active,int count){
+	float peak[MAX_LIGHTS];
+	float dist[MAX_LIGHTS];
+	Uint8 merge[MAX_LIGHTS];
+	Uint8 owner[MAX_LIGHTS];
+	Cluster cl[LOD_MAX_VIRTUAL];
+	float threshold = (1.0f - LightLOD.quality)*LOD_THRESHOLD;
+	float x0 = 0,y0 = 0,x1 = 0,y1 = 0,z = 0;
+	int i,k,n,keep,weak = 0,culled = 0,clusters = 0,vmax;
+
+	LightLOD.culled = LightLOD.merged = LightLOD.virtuals = 0;
+	LightLOD.error = 0.0f;
+	LightLOD.dirty = 0;
+	if(count == 0 || LayerSize == 0)
+		return count;
+
+	x0 = x1 = Layer[0].verts[0].trans.x;
+	y0 = y1 = Layer[0].verts[0].trans.y;
+	z = Layer[0].verts[0].trans.z;
+	for(i = 0; i < LayerSize;i++){
+		for(k = 0; k < 4;k += 3){
+			const pvr_vertex_t* v = &Layer[i].verts[k].trans;
+			x0 = MIN(x0,v->x);
+			x1 = MAX(x1,v->x);
+			y0 = MIN(y0,v->y);
+			y1 = MAX(y1,v->y);
+		}
+	}
+
+	for(k = 0; k < count;k++){
+		peak[k] = Peak(active[k],x0,y0,x1,y1,z,&dist[k]);
+		merge[k] = peak[k] > 0.0f && peak[k] < threshold;
+		weak += merge[k];
+		culled += peak[k] == 0.0f;
+	}
+
+	/*
+		Past the cap the weakest of the rest go too, one slot is kept
+		for what gets merged
+	*/
+	keep = count - weak - culled;
+	if(LightLOD.max_lights > 0 && keep + (weak > 0) > LightLOD.max_lights){
+		int cap = MAX(LightLOD.max_lights - 1,0);
+		while(keep > cap){
+			int j = -1;
+			for(k = 0; k < count;k++)
+				if(peak[k] > 0.0f && !merge[k] && (j < 0 || peak[k] < peak[j]))
+					j = k;
+			merge[j] = 1;
+			weak++;
+			keep--;
+		}
+	}
+	if(weak == 0 && culled == 0)
+		return count;
+
+	vmax = LightLOD.max_lights > 0 ? MAX(LightLOD.max_lights - keep,1) : LOD_MAX_VIRTUAL;
+	vmax = MIN(vmax,LOD_MAX_VIRTUAL);
+	for(k = 0; k < count;k++){
+		const Light* l = active[k];
+		Cluster* c;
+		int cx,cy;
+		if(!merge[k])
+			continue;
+		cx = (int)(l->x / LOD_CELL);
+		cy = (int)(l->y / LOD_CELL);
+		for(i = 0; i < clusters;i++)
+			if(cl[i].cx == cx && cl[i].cy == cy)
+				break;
+		if(i == clusters){
+			if(clusters < vmax){
+				c = &cl[clusters++];
+				memset(c,0,sizeof(Cluster));
+				c->cx = cx;
+				c->cy = cy;
+				c->bounded = 1;
+			}else{
+				i = Nearest_Cluster(cl,clusters,cx,cy);	// out of virtual lights
+			}
+		}
+		owner[k] = i;
+		c = &cl[i];
+		c->w += peak[k];
+		c->x += l->x*peak[k];
+		c->y += l->y*peak[k];
+		c->z += l->z*peak[k];
+		c->ac += l->ac*peak[k];
+		c->ab += l->ab*peak[k];
+		c->aa += l->aa*peak[k];
+		c->r += l->r;
+		c->g += l->g;
+		c->b += l->b;
+		c->bounded &= l->radius > 0.0f;
+	}
+
+	for(i = 0; i < clusters;i++){
+		Cluster* c = &cl[i];
+		Light* v = &LODLights[i];
+		float inv = 1.0f / c->w;
+		memset(v,0,sizeof(Light));
+		v->x = c->x*inv;
+		v->y = c->y*inv;
+		v->z = c->z*inv;
+		v->w = 1.0f;
+		v->ac = c->ac*inv;
+		v->ab = c->ab*inv;
+		v->aa = c->aa*inv;
+		v->dummy = 1.0f;
+		v->r = c->r;
+		v->g = c->g;
+		v->b = c->b;
+		v->a = 1.0f;
+		v->flags = LIGHT_DYNAMIC;
+		c->w = 0.0f;	// the error from here on
+	}
+
+	/*
+		What each member adds to the error and the radius by moving to
+		the centre
+	*/
+	for(k = 0; k < count;k++){
+		const Light* l = active[k];
+		Cluster* c;
+		float dx,dy,dz,moved;
+		if(!merge[k])
+			continue;
+		c = &cl[owner[k]];
+		dx = LODLights[owner[k]].x - l->x;
+		dy = LODLights[owner[k]].y - l->y;
+		dz = LODLights[owner[k]].z - l->z;
+		moved = dx*dx + dy*dy + dz*dz;
+		moved = moved > 0.0f ? moved*frsqrt(moved) : 0.0f;
+		if(c->bounded)
+			c->reach = MAX(c->reach,moved + l->radius);
+		c->w += peak[k]*MIN(moved / dist[k],1.0f);
+	}
+
+	n = 0;
+	for(k = 0; k < count;k++)
+		if(peak[k] > 0.0f && !merge[k])
+			active[n++] = active[k];
+	for(i = 0; i < clusters;i++){
+		Light* v = &LODLights[i];
+		v->radius = cl[i].bounded ? cl[i].reach : 0.0f;
+		if(v->x != Prev[i].x || v->y != Prev[i].y || v->z != Prev[i].z || v->ac != Prev[i].ac
+			|| v->ab != Prev[i].ab || v->aa != Prev[i].aa || v->radius != Prev[i].radius)
+			LightLOD.dirty |= 1u << i;
+		Prev[i] = *v;
+		LightLOD.error = MAX(LightLOD.error,cl[i].w);
+		active[n++] = v;
+	}
+	LightLOD.culled = culled;
+	LightLOD.merged = weak;
+	LightLOD.virtuals = clusters;
+	return n;
+}
@@ -0,0 +1,45 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "light.h"
+
+/*
+	Light level of detail
+	- Once a frame, before lighting, every light gets the most it could
+	  add to any vertex of the layer: its brightest channel times its
+	  attenuation at the layer's nearest point (N.L taken as 1)
+	- Lights under the quality threshold, and the weakest ones past
+	  max_lights, are merged per LOD_CELL square into virtual lights
+	  at their intensity weighted centre, with their colours summed
+	- Lights whose radius misses the layer are dropped outright
+	- error estimates the most colour a vertex gains or loses: each
+	  merged light's peak scaled by how far it moved against its
+	  distance to the layer, summed per virtual light, worst one kept
+*/
+
+#define LOD_CELL 256	// pixels
+#define LOD_MAX_VIRTUAL 8
+#define LOD_THRESHOLD 0.25f	// peak merged at quality 0
+
+/*
+	Lights and virtual lights share the Uint32 slot masks of the
+	lighting cache, virtual slot i is bit MAX_LIGHTS + i
+*/
+_Static_assert(MAX_LIGHTS + LOD_MAX_VIRTUAL <= 32,"light slots past a Uint32 mask");
+
+typedef struct {
+	float quality;	// 1 merges nothing, 0 merges anything under LOD_THRESHOLD
+	int max_lights;	// lights left after merging, 0 for no cap
+	int culled;	// last frame's counts
+	int merged;
+	int virtuals;
+	float error;
+	Uint32 dirty;	// virtual slots that moved or reshaped, bit per slot
+}LightLODInfo;
+
+extern LightLODInfo LightLOD;
+extern Light LODLights[LOD_MAX_VIRTUAL];
+
+int Light_LOD(Light** active,int count);
+
+#endif
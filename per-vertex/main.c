@@ -13,22 +13,23 @@
 #include <math.h>
 #include <oggvorbis/sndoggvorbis.h>
 #include "light.h"
+#include "shadow.h"
+#include "profile.h"
+#include "texture.h"
+#include "scene.h"
+#include "kernels.h"
+#include "arena.h"
+#include "jobs.h"
+#include "commands.h"
+#include "anim.h"
+#include "ambient.h"
+#ifndef _arch_dreamcast
+#include "raster.h"
+#endif
 //#define print
 // |error| < 0.005
 
 
-/*
-	First Half of the 1024 will go to 32 4-bit palettes
-*/
-static Uint32 Pindex4 = 0;
-/*
-	Second half will go to 2 8-bit palettes
-*/
-static Uint32 Pindex8 = 0;
-
-Vector3 pos3 = {0.0,0.0,1.0,1.0};
-Vector3 pos1 = {0,0,0,1.0};
-Vector3 pos2 = {0,0,0,1.0};
 int LIGHTS = 3;
 
 /* Frustum matrix (does perspective) */
@@ -39,10 +40,11 @@ static matrix_t fr_mat = {
     {       0.0f,       0.0f, 2 * ZFAR*ZNEAR / (ZNEAR - ZFAR),  1.0f }
 };
 
-Texture GlobalNormal;
-Texture GlobalTex;
+Texture* GlobalNormal;
+Texture* GlobalTex;
 
-Quad Layer[LAYER_SIZE];
+Quad Layer[MAX_LAYER_SIZE];
+int LayerSize = LAYER_SIZE;
 Light Lights[MAX_LIGHTS];
 
 pvr_poly_cxt_t p_cxt;
@@ -77,108 +79,6 @@ float fast_atan2f( float y, float x )
 
 
 
-void DeleteTexture(Texture* t){
-	t->fmt = 0;
-	pvr_mem_free(t->txt);
-}
-
-
-void Load_Texture(const char* fn, Texture* t){
-	FILE* fp;
-	header_t  hdr;
-	fp = fopen(fn,"r");
-	
-	fread(&hdr,sizeof(hdr),1,fp);	// read in the header
-	
-	t->w = hdr.width;
-	t->h = hdr.height;
-	
-	t->fmt = hdr.type;
-	//Allocate texture memory
-	t->txt = pvr_mem_malloc(hdr.size);
-	//Temporary ram storage of texture
-	void* temp = malloc(hdr.size);
-	// Load texture into ram
-	fread(temp,hdr.size,1,fp);
-	// SQ copy into VRAM
-	pvr_txr_load(temp,t->txt,hdr.size);
-	//Free RAM
-	free(temp);
-	temp = NULL;
-	fclose(fp);
-	
-	/*
-		Palette loading and management
-	*/
-	if( ((t->fmt >> 27) & 7) > 4 ) {
-		if(t->fmt & PVR_TXRFMT_PAL4BPP){
-			// Append palette suffix to filepath
-			char pf[64];
-			strcpy(pf,fn);
-			strcat(pf,".pal");
-			fp = fopen(pf,"r");
-			pal_header_t phdr;
-			//read in the 8-byte header
-			fread(&phdr,sizeof(pal_header_t),1,fp);
-			//setup buffer
-			void *palette = malloc(phdr.numcolors*4);
-			Uint32 i;
-			//Make entries readable to PVR
-			Uint32* packed = (Uint32*)palette;
-			//Load entries in to buffer
-			fread(packed,phdr.numcolors*4,1,fp);
-			//Load palette entries into correct location ( first 512 bank)
-			for(i = Pindex4*16; i < (Pindex4*16) + phdr.numcolors*4;i++){
-				pvr_set_pal_entry(i,packed[i]);
-			}
-			//Set palette #
-			t->palette = Pindex4;
-		
-			t->fmt |=  PVR_TXRFMT_4BPP_PAL(Pindex4);
-		
-		//Increase palettte index to prevent overwrite
-			Pindex4++;
-			//32 possible palettes in 512 bank
-			if(Pindex4 == 32){
-				Pindex4 = 0; // overwrite
-			}
-
-			packed = NULL;
-			free(palette);
-			fclose(fp);
-		} else if(t->fmt & PVR_TXRFMT_PAL8BPP){
-			char pf[64];
-			strcpy(pf,fn);
-			strcat(pf,".pal");
-			fp = fopen(pf,"r");
-			pal_header_t phdr;
-			fread(&phdr,sizeof(pal_header_t),1,fp);
-			void * palette = malloc(phdr.numcolors*4);
-			Uint32 i;
-			Uint32* packed = (Uint32*)palette;
-			fread(packed,phdr.numcolors*4,1,fp);
-			
-			//Load palette entries into the second 512 bank
-			for(i = (512 + Pindex8*256); i < (Pindex8*256 + 512) + phdr.numcolors*4;i++){
-				pvr_set_pal_entry(i,packed[i]);
-			}
-			
-			t->palette = Pindex8 | 0x80;
-			t->fmt |=  PVR_TXRFMT_8BPP_PAL(Pindex8+2);
-			Pindex8++;
-			
-			//Only 2 8-bit palettes can fit into second 512 bank
-			if(Pindex8 == 2){
-				Pindex8 = 0;
-			}
-		
-			packed = NULL;
-			free(palette);
-			fclose(fp);
-		}
-	}
-	
-}
 /*
 	calculates the cross product of 2 vectors
 */
@@ -191,7 +91,7 @@ inline void Cross(Vector3 *v1,Vector3* v2,Vector3 *out){
 
 
 inline void LightQuad(Quad  *qd,Light* l){
-	int i;
+	Vector3 pos1,pos2,pos3,temp;
 
 	pos1.x = qd->verts[1].p.x - qd->verts[0].p.x;
 	pos1.y = qd->verts[1].p.y - qd->verts[0].p.y;
@@ -201,69 +101,84 @@ inline void LightQuad(Quad  *qd,Light* l){
 	pos2.z = qd->verts[2].p.z - qd->verts[0].p.z;
 	Cross(&pos1,&pos2,&pos3);
 	normalize(&pos3,&qd->surfacenormal);
-	static Vector3 temp;
 	temp.w = 1.0;
 	temp.x = qd->verts[0].trans.x;
 	temp.y = qd->verts[0].trans.y;
 	temp.z = qd->verts[0].trans.z;
-	_lightvertex(&temp,l,&qd->verts[0].FinalColor,&qd->surfacenormal);
+	if(Light_Reaches(l,temp.x,temp.y))
+		_lightvertex(&temp,l,&qd->verts[0].FinalColor,&qd->surfacenormal);
 	temp.x = qd->verts[1].trans.x;
 	temp.y = qd->verts[1].trans.y;
 	temp.z = qd->verts[1].trans.z;
-	_lightvertex(&temp,l,&qd->verts[1].FinalColor,&qd->surfacenormal);
+	if(Light_Reaches(l,temp.x,temp.y))
+		_lightvertex(&temp,l,&qd->verts[1].FinalColor,&qd->surfacenormal);
 	temp.x = qd->verts[2].trans.x;
 	temp.y = qd->verts[2].trans.y;
 	temp.z = qd->verts[2].trans.z;
-	_lightvertex(&temp,l,&qd->verts[2].FinalColor,&qd->surfacenormal);
+	if(Light_Reaches(l,temp.x,temp.y))
+		_lightvertex(&temp,l,&qd->verts[2].FinalColor,&qd->surfacenormal);
 	temp.x = qd->verts[3].trans.x;
 	temp.y = qd->verts[3].trans.y;
 	temp.z = qd->verts[3].trans.z;
-	_lightvertex(&temp,l,&qd->verts[3].FinalColor,&qd->surfacenormal);
+	if(Light_Reaches(l,temp.x,temp.y))
+		_lightvertex(&temp,l,&qd->verts[3].FinalColor,&qd->surfacenormal);
 }
 
-void Draw_Bump(Quad *qd){
-	int i;
-	pvr_poly_cxt_txr(&p_cxt,PVR_LIST_TR_POLY,qd->mat.bumpmap.fmt,qd->mat.bumpmap.w,qd->mat.bumpmap.w,qd->mat.bumpmap.txt,PVR_FILTER_BILINEAR);
+void Draw_Bump_Header(Texture* bump){
+	PROF_BEGIN(PROF_HEADER);
+	pvr_poly_cxt_txr(&p_cxt,PVR_LIST_TR_POLY,bump->fmt,bump->w,bump->h,bump->txt,PVR_FILTER_BILINEAR);
 	p_cxt.gen.specular = PVR_SPECULAR_ENABLE;
 	pvr_poly_compile(&p_hdr,&p_cxt);
+	PROF_END(PROF_HEADER);
 	//p_hdr.cmd |= 4;
-	
-	/*
-		Average out the light source positions
-	*/
-	static Vector3 D;
-	static Vector3 G;
+	pvr_prim(&p_hdr,sizeof(pvr_poly_hdr_t));
+}
+
+/*
+	Average out the light source positions, once a frame
+*/
+void Bump_Centre(Vector3* G){
+	int i;
 	if(LIGHTS > 1){
-		G.x =0;
-		G.y = 0;
-		G.z = 0;
+		G->x = 0;
+		G->y = 0;
+		G->z = 0;
 		for(i = 0; i < LIGHTS;i++){
-			G.x += Lights[i].x;
-			G.y += Lights[i].y;
-			G.z += Lights[i].z;
+			G->x += Lights[i].x;
+			G->y += Lights[i].y;
+			G->z += Lights[i].z;
 		}
-		G.x /= LIGHTS;
-		G.y /= LIGHTS;
-		G.z /= LIGHTS;
-		D.x = (qd->verts[0].p.x+16) - G.x;
-		D.y = (qd->verts[0].p.y+16) - G.y;
-		D.z = (qd->verts[0].p.z) - G.z;
+		G->x /= LIGHTS;
+		G->y /= LIGHTS;
+		G->z /= LIGHTS;
 	}else{
-		D.x = (qd->verts[0].p.x+16) - Lights[0].x;
-		D.y = (qd->verts[0].p.y+16) - Lights[0].y;
-		D.z = (qd->verts[0].p.z) - Lights[0].z;
+		G->x = Lights[0].x;
+		G->y = Lights[0].y;
+		G->z = Lights[0].z;
 	}
+}
+
+Uint32 Bump_Param(const Quad* qd,const Vector3* G){
+	Vector3 D;
+	D.x = (qd->verts[0].p.x+16) - G->x;
+	D.y = (qd->verts[0].p.y+16) - G->y;
+	D.z = (qd->verts[0].p.z) - G->z;
 	/*
 		Calculate Spherical elevation and rotation angles
 	*/
 	float T = (frsqrt(fipr_magnitude_sqr(D.x,D.y,D.z,0.0)))*PI2;
 
 	float Q = (fast_atan2f(D.y,D.x));
-	pvr_prim(&p_hdr,sizeof(pvr_poly_hdr_t));
 	/*
 		Pack bump paramters, 1.0 is the "bumpiness"
 	*/
-	Uint32 oargb = pvr_pack_bump(1.0,T,Q);
+	return pvr_pack_bump(1.0,T,Q);
+}
+
+/*
+	Expects the bumpmap's header to have been sent already
+*/
+void Draw_Bump(Quad *qd,Uint32 oargb){
 	qd->verts[0].trans.argb = 0xff000000;
 	qd->verts[0].trans.oargb = oargb;
 	pvr_prim(&qd->verts[0].trans,sizeof(pvr_vertex_t));
@@ -314,64 +229,91 @@ inline void Draw_Quad(Quad* qd){
 
 	qd->verts[0].trans.argb = PVR_PACK_COLOR(0.0,qd->verts[0].FinalColor.x,qd->verts[0].FinalColor.y,qd->verts[0].FinalColor.z);
 	pvr_prim(&qd->verts[0].trans,sizeof(pvr_vertex_t));
-	qd->verts[0].FinalColor.x = 0;
-	qd->verts[0].FinalColor.y = 0;
-	qd->verts[0].FinalColor.z = 0; 
+	qd->verts[0].FinalColor.x = MIN(qd->verts[0].c.x + qd->base.x,1.0f);
+	qd->verts[0].FinalColor.y = MIN(qd->verts[0].c.y + qd->base.y,1.0f);
+	qd->verts[0].FinalColor.z = MIN(qd->verts[0].c.z + qd->base.z,1.0f);
 		
 	qd->verts[1].trans.argb = PVR_PACK_COLOR(0.0,qd->verts[1].FinalColor.x,qd->verts[1].FinalColor.y, \
 												qd->verts[1].FinalColor.z);;
 	pvr_prim(&qd->verts[1].trans,sizeof(pvr_vertex_t));
-	qd->verts[1].FinalColor.x = 0;
-	qd->verts[1].FinalColor.y = 0;
-	qd->verts[1].FinalColor.z = 0; 
+	qd->verts[1].FinalColor.x = MIN(qd->verts[1].c.x + qd->base.x,1.0f);
+	qd->verts[1].FinalColor.y = MIN(qd->verts[1].c.y + qd->base.y,1.0f);
+	qd->verts[1].FinalColor.z = MIN(qd->verts[1].c.z + qd->base.z,1.0f);
 		
 	qd->verts[2].trans.argb = PVR_PACK_COLOR(0.0,qd->verts[2].FinalColor.x,qd->verts[2].FinalColor.y, \
 												qd->verts[2].FinalColor.z);;
 	pvr_prim(&qd->verts[2].trans,sizeof(pvr_vertex_t));
-	qd->verts[2].FinalColor.x = 0;
-	qd->verts[2].FinalColor.y = 0;
-	qd->verts[2].FinalColor.z = 0; 
+	qd->verts[2].FinalColor.x = MIN(qd->verts[2].c.x + qd->base.x,1.0f);
+	qd->verts[2].FinalColor.y = MIN(qd->verts[2].c.y + qd->base.y,1.0f);
+	qd->verts[2].FinalColor.z = MIN(qd->verts[2].c.z + qd->base.z,1.0f);
 		
 	qd->verts[3].trans.argb = PVR_PACK_COLOR(0.0,qd->verts[3].FinalColor.x,qd->verts[3].FinalColor.y, \
 												qd->verts[3].FinalColor.z);;
 	pvr_prim(&qd->verts[3].trans,sizeof(pvr_vertex_t));
-	qd->verts[3].FinalColor.x = 0;
-	qd->verts[3].FinalColor.y = 0;
-	qd->verts[3].FinalColor.z = 0; 
+	qd->verts[3].FinalColor.x = MIN(qd->verts[3].c.x + qd->base.x,1.0f);
+	qd->verts[3].FinalColor.y = MIN(qd->verts[3].c.y + qd->base.y,1.0f);
+	qd->verts[3].FinalColor.z = MIN(qd->verts[3].c.z + qd->base.z,1.0f);
+}
+
+static void Transform_Job(void* arg,int first,int end){
+	int i = end;
+	while(i-- > first)
+		Transform_Quad(&Layer[i]);
 }
 
+/*
+	Transform and lighting are split across the job threads in tile
+	rows, Jobs_Parallel_For() returns once every row is done so the
+	submission below sees the finished layer
+*/
 void Draw_Layer(){
+	Texture* last = NULL;
 	int i;
-	int z;
-	i = LAYER_SIZE;
-	while(i--){
-		Transform_Quad(&Layer[i]);
-	}
-	
-	i = LAYER_SIZE;
+	PROF_BEGIN(PROF_TRANSFORM);
+	Jobs_Parallel_For(Transform_Job,NULL,LayerSize,TILE_ROW);
+	PROF_END(PROF_TRANSFORM);
+	
+	PROF_BEGIN(PROF_LIGHTING);
+	Ambient_Update();
+	Light_Layer();
+	PROF_END(PROF_LIGHTING);
+	/*
+		Submit is the whole loop, the few header compiles in it are
+		also in header
+	*/
+	PROF_BEGIN(PROF_SUBMIT);
+	i = LayerSize;
 	while(i--){
-		z = LIGHTS;
-		while(z--){
-			LightQuad(&Layer[i],&Lights[z]);
+		Texture* tex = Tex_Use(Layer[i].mat.texture,&TexFallback);
+		/*
+			The layer is sorted by texture, only send a header when
+			it changes
+		*/
+		if(tex != last){
+			PROF_BEGIN(PROF_HEADER);
+			pvr_poly_cxt_txr(&p_cxt,PVR_LIST_OP_POLY,tex->fmt,tex->w,tex->h,tex->txt,PVR_FILTER_BILINEAR);
+			p_cxt.gen.shading = PVR_SHADE_GOURAUD;
+			pvr_poly_compile(&p_hdr,&p_cxt);
+			PROF_END(PROF_HEADER);
+			pvr_prim(&p_hdr,sizeof(p_hdr));
+			last = tex;
 		}
-	}
-	i = LAYER_SIZE;
-	while(i--){
-		pvr_poly_cxt_txr(&p_cxt,PVR_LIST_OP_POLY,GlobalTex.fmt,GlobalTex.w,GlobalTex.h,GlobalTex.txt,PVR_FILTER_BILINEAR);
-		p_cxt.gen.shading = PVR_SHADE_GOURAUD;
-		pvr_poly_compile(&p_hdr,&p_cxt);
-		pvr_prim(&p_hdr,sizeof(p_hdr));
 		Draw_Quad(&Layer[i]);
 	}
+	PROF_END(PROF_SUBMIT);
 }
 
-void Init_Quad(Quad* qd,float x,float y,float z,float w,float h){
+/*
+	u0,v0 - u1,v1 is the part of the texture the quad shows, an atlas
+	region or the whole thing
+*/
+void Init_Quad_UV(Quad* qd,float x,float y,float z,float w,float h,float u0,float v0,float u1,float v1){
 	qd->verts[0].p.x = x;
 	qd->verts[0].p.y = y;
 	qd->verts[0].p.z = z;
 	qd->verts[0].p.flags = PVR_CMD_VERTEX;
-	qd->verts[0].p.u = 0.0;
-	qd->verts[0].p.v = 0.0;
+	qd->verts[0].p.u = u0;
+	qd->verts[0].p.v = v0;
 	qd->verts[0].p.oargb = 0;
 	
 	memset(&qd->verts[0].trans,0,sizeof(qd->verts[0].trans));
@@ -385,8 +327,8 @@ void Init_Quad(Quad* qd,float x,float y,float z,float w,float h){
 	qd->verts[1].p.y = y;
 	qd->verts[1].p.z = z;
 	qd->verts[1].p.flags = PVR_CMD_VERTEX;
-	qd->verts[1].p.u = 1.0;
-	qd->verts[1].p.v = 0.0;
+	qd->verts[1].p.u = u1;
+	qd->verts[1].p.v = v0;
 	qd->verts[1].p.oargb = 0;
 	
 	memset(&qd->verts[1].trans,0,sizeof(qd->verts[1].trans));
@@ -399,8 +341,8 @@ void Init_Quad(Quad* qd,float x,float y,float z,float w,float h){
 	qd->verts[2].p.y = y+h;
 	qd->verts[2].p.z = z;
 	qd->verts[2].p.flags = PVR_CMD_VERTEX;
-	qd->verts[2].p.u = 0.0;
-	qd->verts[2].p.v = 1.0;
+	qd->verts[2].p.u = u0;
+	qd->verts[2].p.v = v1;
 	qd->verts[2].p.oargb = 0;
 	
 	memset(&qd->verts[2].trans,0,sizeof(qd->verts[2].trans));
@@ -413,8 +355,8 @@ void Init_Quad(Quad* qd,float x,float y,float z,float w,float h){
 	qd->verts[3].p.y = y+h;
 	qd->verts[3].p.z = z;
 	qd->verts[3].p.flags = PVR_CMD_VERTEX_EOL;
-	qd->verts[3].p.u = 1.0;
-	qd->verts[3].p.v = 1.0;
+	qd->verts[3].p.u = u1;
+	qd->verts[3].p.v = v1;
 	qd->verts[3].p.oargb = 0;
 	
 	memset(&qd->verts[3].trans,0,sizeof(qd->verts[3].trans));
@@ -431,6 +373,17 @@ void Init_Quad(Quad* qd,float x,float y,float z,float w,float h){
 	qd->mat.Diffuse.y = 0.0;
 	qd->mat.Diffuse.z = 0.0;
 
+	/*
+		Takes all of the global ambient, emits nothing
+	*/
+	qd->mat.Emissive.x = 0.0;
+	qd->mat.Emissive.y = 0.0;
+	qd->mat.Emissive.z = 0.0;
+	qd->mat.Ambient.x = 1.0;
+	qd->mat.Ambient.y = 1.0;
+	qd->mat.Ambient.z = 1.0;
+	memset(&qd->base,0,sizeof(qd->base));
+
 	qd->surfacenormal.x = 0;
 	qd->surfacenormal.y = 0;
 	qd->surfacenormal.z = 1.0;
@@ -438,35 +391,106 @@ void Init_Quad(Quad* qd,float x,float y,float z,float w,float h){
 	
 	qd->mat.bumpmapped  = 1.0;
 
-	qd->mat.bumpmap.txt = GlobalNormal.txt;
-	qd->mat.bumpmap.w = GlobalNormal.w;
-	qd->mat.bumpmap.h = GlobalNormal.h;
-	qd->mat.bumpmap.fmt = GlobalNormal.fmt;
+	qd->mat.texture = GlobalTex;
+	qd->mat.bumpmap = GlobalNormal;
 
 	qd->mat.shine = 1.0;
 
 }
 
-void Init_Layer(){
+void Init_Quad(Quad* qd,float x,float y,float z,float w,float h){
+	Init_Quad_UV(qd,x,y,z,w,h,0.0,0.0,1.0,1.0);
+}
+
+static int Cmp_Quad_Texture(const void* a,const void* b){
+	const Quad* x = (const Quad*)a;
+	const Quad* y = (const Quad*)b;
+	if(x->mat.texture != y->mat.texture)
+		return x->mat.texture < y->mat.texture ? -1 : 1;
+	if(x->mat.bumpmap != y->mat.bumpmap)
+		return x->mat.bumpmap < y->mat.bumpmap ? -1 : 1;
+	/*
+		Row by row within a texture, qsort isn't stable
+	*/
+	if(x->verts[0].p.y != y->verts[0].p.y)
+		return x->verts[0].p.y < y->verts[0].p.y ? -1 : 1;
+	return (x->verts[0].p.x > y->verts[0].p.x) - (x->verts[0].p.x < y->verts[0].p.x);
+}
+
+/*
+	Groups the layer by texture so Draw_Layer() and Draw_Layer_Bump()
+	only send a header when it changes, call again after pointing
+	quads at different textures or atlas regions
+*/
+void Sort_Layer(){
+	qsort(Layer,LayerSize,sizeof(Quad),Cmp_Quad_Texture);
+	Light_Cache_Invalidate();
+	Ambient_Invalidate();
+}
+
+/*
+	Lays out "count" tiles row by row, wrapping every "width" pixels
+*/
+void Init_Layer_Size(int count,float width,float tile){
 	int i;
 	float x = 0;
 	float y = 0;
 	float z = 1.0;
-	for(i = 0; i < LAYER_SIZE;i++){
-		Init_Quad(&Layer[i],x,y,z,TILE,TILE);
-		x += TILE;
-		if(x == 640){
+	if(count > MAX_LAYER_SIZE)
+		count = MAX_LAYER_SIZE;
+	LayerSize = count;
+	for(i = 0; i < count;i++){
+		Init_Quad(&Layer[i],x,y,z,tile,tile);
+		x += tile;
+		if(x >= width){
 			x = 0.0;
-			y += TILE;
+			y += tile;
 		}
 	}
+	Sort_Layer();
+}
+
+void Init_Layer(){
+	Init_Layer_Size(LAYER_SIZE,640,TILE);
+}
+
+typedef struct {
+	Uint32* params;
+	Vector3 G;
+}BumpJob;
+
+static void Bump_Job(void* arg,int first,int end){
+	BumpJob* job = arg;
+	int i = end;
+	while(i-- > first)
+		if(Layer[i].mat.bumpmapped == 1)
+			job->params[i] = Bump_Param(&Layer[i],&job->G);
 }
 
 void Draw_Layer_Bump(){
-	int i = LAYER_SIZE;
+	Texture* last = NULL;
+	Uint32* params = Arena_New(&FrameArena,Uint32,LayerSize);
+	BumpJob job;
+	int i;
+
+	/*
+		Bump parameters for the whole layer first (on the job threads),
+		then submission
+	*/
+	Bump_Centre(&job.G);
+	if(params){
+		job.params = params;
+		Jobs_Parallel_For(Bump_Job,&job,LayerSize,TILE_ROW);
+	}
+	i = LayerSize;
 	while(i--){
 		if(Layer[i].mat.bumpmapped == 1){
-			Draw_Bump(&Layer[i]);
+			Texture* bump = Tex_Use(Layer[i].mat.bumpmap,&TexFallbackBump);
+			if(bump != last){
+				Draw_Bump_Header(bump);
+				last = bump;
+			}
+			Draw_Bump(&Layer[i],params ? params[i] : Bump_Param(&Layer[i],&job.G));
 		}
 	}
 }
@@ -526,125 +550,143 @@ KOS_INIT_ROMDISK(romdisk);
 int main(int argc,char **argv){
 	Init();
 	//sndoggvorbis_start("/pc/billy.ogg",-1);
-	Lights[0].z = 10.0;
-	Lights[0].x = 0.0;
-	Lights[0].y = 0.0;
-	Lights[0].w = 1.0;
-	Lights[0].r = 5.0;
-	Lights[0].g = 0.0;
-	Lights[0].b = 0.0;
-	Lights[0].a = 1.0;
-	Lights[0].aa = 0.0;
-	Lights[0].ab = 0.0;
-	Lights[0].ac = 1.0;
-	Lights[0].dummy = 1.0;
-	
-	Lights[1].z = 10.0;
-	Lights[1].x = 100.0;
-	Lights[1].y = 100.0;
-	Lights[1].w = 1.0;
-	Lights[1].r = 0.0;
-	Lights[1].g = 5.0;
-	Lights[1].b = 0.0;
-	Lights[1].a = 1.0;
-	Lights[1].aa = 0.0;
-	Lights[1].ab = 0.0;
-	Lights[1].ac = 1.0;
-	Lights[1].dummy = 1.0;
-	
-	Lights[2].z = 10.0;
-	Lights[2].x = 400.0;
-	Lights[2].y = 400.0;
-	Lights[2].w = 1.0;
-	Lights[2].r = 0.0;
-	Lights[2].g = 0.0;
-	Lights[2].b = 5.0;
-	Lights[2].a = 1.0;
-	Lights[2].aa = 0.0;
-	Lights[2].ab = 0.0;
-	Lights[2].ac = 1.0;
-	Lights[2].dummy = 1.0;
-
-	
-	vid_border_color(255,0,0);
-	Load_Texture("/rd/bumpmap.raw",&GlobalNormal);
-	Load_Texture("/rd/text.raw",&GlobalTex);
-	vid_border_color(0,0,255);
-	Init_Layer();
 	
+	/*
+		Textures stream in while the layer already renders with the
+		fallbacks
+	*/
+	Tex_Stream_Init();
+	Jobs_Init(0);
+	Tex_Cache_Init(TEX_CACHE_BUDGET);
 	
+	/*
+		Layer, lights and the walls for the shadow test (toggled with
+		L) come from scenes/demo.txt
+	*/
+	Scene scene;
+	if(Load_Scene(ROMDISK_PATH "demo.scn",&scene) == 0){
+		const char* bake = ROMDISK_PATH "demo.col";
+		int need_bake = 0;
+#ifndef _arch_dreamcast
+		/*
+			--bake names one that has to load, make check draws the
+			demo with and without it against the same reference
+		*/
+		int i;
+		for(i = 1; i < argc - 1;i++){
+			if(strcmp(argv[i],"--bake") == 0){
+				bake = argv[i + 1];
+				need_bake = 1;
+			}
+		}
+#endif
+		Apply_Scene(&scene);
+		/*
+			Static lights from host/bake.c, if there's a bake
+		*/
+		if(Load_Bake(bake,&scene) != 0 && need_bake){
+			fprintf(stderr,"%s: not a bake of demo.scn\n",bake);
+			return 1;
+		}
+	}else{
+		Init_Layer();
+	}
 	
 	int q = 0;
 	int x = 0;
 	int pushed = 0;
 	int bumpenabled = 1;
 	int display_fps = 0;
+	/*
+		The input side's own copy of what it has asked for, it only
+		talks to the renderer through RenderCmds
+	*/
+	int lights = LIGHTS;
+	int shadows = SHADOWS;
+	Uint32 frame = 0;
+#ifndef _arch_dreamcast
+	/*
+		No controller on the host, run a fixed number of frames instead,
+		counted once the streamed textures are in so the last frame
+		always looks the same
+	*/
+	int frames = argc > 1 && argv[1][0] != '-' ? atoi(argv[1]) : 600;
+#endif
 	bfont_set_encoding(BFONT_CODE_ISO8859_1);
 	while(q == 0){
+		PROF_BEGIN(PROF_FRAME);
 		mat_identity();
 
 		
-		vid_border_color(255,0,0);
+		PROF_BEGIN(PROF_WAIT);
 		pvr_wait_ready();
-		vid_border_color(0,255,0);
+		PROF_END(PROF_WAIT);
+		PROF_BEGIN(PROF_UPLOAD);
+		Tex_Stream_Update(TEX_UPLOAD_BUDGET);
+		PROF_END(PROF_UPLOAD);
+		Arena_Reset(&FrameArena);
+		Cmd_Drain(&RenderCmds);
+		Light_Anim_Update(frame++ * (1.0f / 60.0f));
 		pvr_scene_begin();
 		pvr_list_begin(PVR_LIST_OP_POLY);
 			Draw_Layer();
 		pvr_list_finish();
 		
 		pvr_list_begin(PVR_LIST_TR_POLY);
+		PROF_BEGIN(PROF_BUMP);
 		if(bumpenabled)
 			Draw_Layer_Bump();
+		PROF_END(PROF_BUMP);
 		pvr_list_finish();
 		
 		pvr_scene_finish();
-		vid_border_color(0,0,255);
 	
 		MAPLE_FOREACH_BEGIN(MAPLE_FUNC_CONTROLLER, cont_state_t, st);
 			if(st->buttons & CONT_START)
 				q = 1;
 			
 			if(st->joyx > 32){
-				Lights[x].x += 4.0f;
+				Cmd_Light_Move(x,4.0f,0.0f,0.0f);
 			}
 			if(st->joyx < -32){
-				Lights[x].x -= 4.0f;
+				Cmd_Light_Move(x,-4.0f,0.0f,0.0f);
 			}
 			if(st->joyy < -32){
-				Lights[x].y -= 4.0f;
+				Cmd_Light_Move(x,0.0f,-4.0f,0.0f);
 			}
 			if(st->joyy > 32){
-				Lights[x].y += 4.0f;
+				Cmd_Light_Move(x,0.0f,4.0f,0.0f);
 			}
 			
 			
 			if(st->buttons & CONT_DPAD_LEFT){
-				Lights[x].x -= 4.0f;
+				Cmd_Light_Move(x,-4.0f,0.0f,0.0f);
 			}
 			if(st->buttons & CONT_DPAD_RIGHT){
-				Lights[x].x += 4.0f;
+				Cmd_Light_Move(x,4.0f,0.0f,0.0f);
 			}
 			if(st->buttons & CONT_DPAD_UP){
-				Lights[x].y -= 4;
+				Cmd_Light_Move(x,0.0f,-4.0f,0.0f);
 			}
 			if(st->buttons & CONT_DPAD_DOWN){
-				Lights[x].y += 4;
+				Cmd_Light_Move(x,0.0f,4.0f,0.0f);
 			}
 				
 			if(st->buttons & CONT_A && pushed == 0){
 				pushed = 1;
 				x++;
-				if(x == LIGHTS){
+				if(x >= lights){
 					x = 0;
 				}
 			} 
 			
 			if(st->buttons & CONT_Y && pushed == 0){
-				LIGHTS--;
+				lights--;
 				pushed = 1;
-				if(LIGHTS < 0){
-					LIGHTS = MAX_LIGHTS;
+				if(lights < 0){
+					lights = MAX_LIGHTS;
 				}
+				Cmd_Light_Count(lights);
 			}
 			
 			if(st->buttons & CONT_B && pushed == 0){
@@ -657,24 +699,57 @@ int main(int argc,char **argv){
 				pushed = 1;
 			}
 			
-			if(!(st->buttons & CONT_A) && !(st->buttons & CONT_B) && !(st->buttons & CONT_X) && !(st->buttons & CONT_Y)){
+			if(st->ltrig > 128 && pushed == 0){
+				shadows ^= 0x01;
+				Cmd_Shadows(shadows);
+				pushed = 1;
+			}
+			
+			if(!(st->buttons & CONT_A) && !(st->buttons & CONT_B) && !(st->buttons & CONT_X) && !(st->buttons & CONT_Y) \
+				&& st->ltrig <= 128){
 				pushed = 0;
 			}
 			
 		
 		MAPLE_FOREACH_END();
+		if(Scene_Poll(&scene,SCENE_RELOAD_PATH "demo.scn") & SCENE_CHANGED_LIGHTS)
+			lights = LIGHTS;
 		running_stats();
 		sprintf(buf,"FPS:%f",avgfps);
 		if(display_fps){
 				//printf("%s\n",buf);
 			bfont_draw_str(vram_s + (640*24),640,1,buf);
+			PROF_OVERLAY(2);
 		}
+		PROF_END(PROF_FRAME);
+		PROF_FRAME_END();
+#ifndef _arch_dreamcast
+		if(!Tex_Stream_Pending() && --frames <= 0)
+			q = 1;
+#endif
 		
 	}
-	DeleteTexture(&GlobalNormal);
-	DeleteTexture(&GlobalTex);
+	PROF_DUMP(PROF_CSV_PATH);
+#ifdef PROFILE
+	Tex_Print_Stats();
+	Arena_Print_Stats("frame arena",&FrameArena);
+#endif
+#ifndef _arch_dreamcast
+	/*
+		Reference image of the last frame for --dump / --compare
+	*/
+	int status = Raster_Host_Args(argc,argv);
+#endif
+	Tex_Stream_Shutdown();
+	Jobs_Shutdown();
+	Free_Scene(&scene);
+	Tex_Cache_Shutdown();
 	//sndoggvorbis_stop();
 	//sndoggvorbis_shutdown();
 	pvr_shutdown();
+#ifndef _arch_dreamcast
+	return status;
+#else
 	return 0;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,147 @@
+/*
+	Palette RAM allocator
+	- Slot 0 is the first 16 entries, 8bpp banks start on multiples of
+	  PAL_BANK_SLOTS
+	- 4bpp palettes are taken from the top down and 8bpp banks from the
+	  bottom up, so small palettes don't break up the big banks
+	- A shadow copy of palette RAM is kept to confirm hash matches
+*/
+
+#include <kos.h>
+#include "palette.h"
+
+typedef struct {
+	Uint32 hash;
+	uint16 refs;
+	Uint8 slots;	// 1 for 4bpp, PAL_BANK_SLOTS for 8bpp, 0 if not a palette start
+	Uint8 used;	// slot belongs to a live palette
+}PalSlot;
+
+PalStats PaletteStats;
+
+static PalSlot Slots[PAL_SLOTS];
+static Uint32 Shadow[PAL_ENTRIES];
+
+static Uint32 Pal_Hash(const Uint32* colors,int count){
+	Uint32 h = 2166136261u;
+	int i;
+	for(i = 0; i < count;i++)
+		h = (h ^ colors[i]) * 16777619u;
+	return h ^ count;
+}
+
+/*
+	One pass straight into the palette registers instead of a call per
+	entry
+*/
+static void Pal_Upload(int slot,const Uint32* colors,int count){
+	int base = slot * PAL_SLOT;
+	int i;
+#ifdef _arch_dreamcast
+	vuint32* dst = (vuint32*)(0xa05f8000 + PVR_PALETTE_TABLE_BASE) + base;
+	for(i = 0; i < count;i++)
+		dst[i] = colors[i];
+#else
+	for(i = 0; i < count;i++)
+		pvr_set_pal_entry(base + i,colors[i]);
+#endif
+	memcpy(&Shadow[base],colors,count * sizeof(Uint32));
+	PaletteStats.uploads++;
+}
+
+static int Pal_Find(const Uint32* colors,int count,int slots,Uint32 hash){
+	int i;
+	for(i = 0; i < PAL_SLOTS;i++){
+		PalSlot* s = &Slots[i];
+		if(s->slots == slots && s->hash == hash
+			&& memcmp(&Shadow[i * PAL_SLOT],colors,count * sizeof(Uint32)) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static int Pal_Free_Run(int slot,int slots){
+	int i;
+	for(i = 0; i < slots;i++)
+		if(Slots[slot + i].used)
+			return 0;
+	return 1;
+}
+
+static int Pal_Alloc(int slots){
+	int i;
+	if(slots == 1){
+		for(i = PAL_SLOTS - 1; i >= 0;i--)
+			if(!Slots[i].used)
+				return i;
+		return -1;
+	}
+	for(i = 0; i + slots <= PAL_SLOTS;i += slots)
+		if(Pal_Free_Run(i,slots))
+			return i;
+	return -1;
+}
+
+/*
+	Returns the first slot of a resident copy of the palette, uploading
+	it if needed, or -1 when palette RAM is full. Shorter palettes are
+	padded with zeros so equal content always hashes the same
+*/
+int Pal_Acquire(const Uint32* colors,int count,int bpp8){
+	Uint32 padded[256];
+	int size = bpp8 ? 256 : 16;
+	int slots = bpp8 ? PAL_BANK_SLOTS : 1;
+	Uint32 hash;
+	int slot,i;
+
+	if(count < 0)
+		count = 0;
+	if(count > size)
+		count = size;
+	memcpy(padded,colors,count * sizeof(Uint32));
+	memset(padded + count,0,(size - count) * sizeof(Uint32));
+	hash = Pal_Hash(padded,size);
+
+	slot = Pal_Find(padded,size,slots,hash);
+	if(slot >= 0){
+		Slots[slot].refs++;
+		PaletteStats.shared++;
+		return slot;
+	}
+	slot = Pal_Alloc(slots);
+	if(slot < 0){
+		PaletteStats.failed++;
+		return -1;
+	}
+	for(i = 0; i < slots;i++)
+		Slots[slot + i].used = 1;
+	Slots[slot].slots = slots;
+	Slots[slot].refs = 1;
+	Slots[slot].hash = hash;
+	PaletteStats.slots_used += slots;
+	Pal_Upload(slot,padded,size);
+	return slot;
+}
+
+void Pal_Release(int slot){
+	PalSlot* s;
+	int i;
+	if(slot < 0 || slot >= PAL_SLOTS)
+		return;
+	s = &Slots[slot];
+	if(s->slots == 0 || s->refs == 0 || --s->refs > 0)
+		return;
+	PaletteStats.slots_used -= s->slots;
+	for(i = s->slots - 1; i >= 0;i--)
+		memset(&Slots[slot + i],0,sizeof(PalSlot));
+}
+
+/*
+	Texture format bits selecting the palette, 8bpp textures only use
+	the top two bits of the selector
+*/
+Uint32 Pal_Format(int slot){
+	if(Slots[slot].slots == PAL_BANK_SLOTS)
+		return PVR_TXRFMT_8BPP_PAL(slot / PAL_BANK_SLOTS);
+	return PVR_TXRFMT_4BPP_PAL(slot);
+}
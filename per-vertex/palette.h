@@ -0,0 +1,33 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include "light.h"
+
+/*
+	Palette RAM allocator
+	- The 1024 palette entries are handed out as 64 slots of 16, a 4bpp
+	  palette takes one slot and an 8bpp palette a 256 entry aligned
+	  bank of 16 slots
+	- Identical palettes are shared and reference counted, so textures
+	  cut from the same source don't each burn a bank
+*/
+
+#define PAL_ENTRIES 1024
+#define PAL_SLOT 16
+#define PAL_SLOTS (PAL_ENTRIES/PAL_SLOT)
+#define PAL_BANK_SLOTS (256/PAL_SLOT)
+
+typedef struct {
+	Uint32 uploads;	// palettes written to palette RAM
+	Uint32 shared;	// requests served by an identical resident palette
+	Uint32 failed;	// no room left
+	Uint32 slots_used;
+}PalStats;
+
+extern PalStats PaletteStats;
+
+int Pal_Acquire(const Uint32* colors,int count,int bpp8);
+void Pal_Release(int slot);
+Uint32 Pal_Format(int slot);
+
+#endif
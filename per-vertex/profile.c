@@ -0,0 +1,130 @@
+/*
+	Per-stage frame profiler
+	- timer_ns_gettime64 on the Dreamcast, clock_gettime on the host.
+	  Stages add up in nanoseconds and are only turned into
+	  microseconds once a frame, so short intervals don't truncate to 0
+	- Keeps the last PROF_HISTORY frames of every stage in a ring
+*/
+
+#include <kos.h>
+#include "profile.h"
+
+#ifdef PROFILE
+
+#ifndef _arch_dreamcast
+#include <time.h>
+#endif
+
+static const char* StageNames[PROF_STAGES] = {
+	"transform",
+	"lighting",
+	"bump",
+	"header",
+	"submit",
+	"wait",
+	"upload",
+	"frame"
+};
+
+static uint64 Start[PROF_STAGES];
+static uint64 Accum[PROF_STAGES];	// nanoseconds
+static Uint32 History[PROF_STAGES][PROF_HISTORY];
+static Uint32 Head = 0;
+static Uint32 Frames = 0;
+
+static inline uint64 Prof_Now(){
+#ifdef _arch_dreamcast
+	return timer_ns_gettime64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64)ts.tv_sec*1000000000 + ts.tv_nsec;
+#endif
+}
+
+void Prof_Begin(int stage){
+	Start[stage] = Prof_Now();
+}
+
+void Prof_End(int stage){
+	Accum[stage] += Prof_Now() - Start[stage];
+}
+
+/*
+	Pushes this frame's totals into the ring and clears the accumulators
+*/
+void Prof_Frame_End(){
+	int i;
+	for(i = 0; i < PROF_STAGES;i++){
+		History[i][Head] = (Uint32)((Accum[i] + 500) / 1000);
+		Accum[i] = 0;
+	}
+	Head = (Head + 1) & (PROF_HISTORY-1);
+	if(Frames < PROF_HISTORY)
+		Frames++;
+}
+
+static int Cmp_U32(const void* a,const void* b){
+	Uint32 x = *(const Uint32*)a;
+	Uint32 y = *(const Uint32*)b;
+	return (x > y) - (x < y);
+}
+
+void Prof_Get_Stats(int stage,ProfStats* out){
+	Uint32 sorted[PROF_HISTORY];
+	Uint32 i;
+	uint64 sum = 0;
+	memset(out,0,sizeof(ProfStats));
+	if(Frames == 0)
+		return;
+	memcpy(sorted,History[stage],Frames*sizeof(Uint32));
+	qsort(sorted,Frames,sizeof(Uint32),Cmp_U32);
+	for(i = 0; i < Frames;i++)
+		sum += sorted[i];
+	out->min = sorted[0];
+	out->max = sorted[Frames-1];
+	out->avg = (Uint32)(sum / Frames);
+	out->p99 = sorted[(Frames*99)/100];
+	out->samples = Frames;
+}
+
+/*
+	One line of min/avg/max/p99 per stage, starting at text row "line"
+*/
+void Prof_Draw_Overlay(int line){
+	char buf[64];
+	ProfStats st;
+	int i;
+	for(i = 0; i < PROF_STAGES;i++){
+		Prof_Get_Stats(i,&st);
+		sprintf(buf,"%-9s %5u %5u %5u %5u",StageNames[i],
+			(unsigned)st.min,(unsigned)st.avg,(unsigned)st.max,(unsigned)st.p99);
+		bfont_draw_str(vram_s + (640*24*(line+i)),640,1,buf);
+	}
+}
+
+/*
+	Writes the whole history, oldest frame first, one row per frame
+*/
+int Prof_Dump_CSV(const char* fn){
+	FILE* fp = fopen(fn,"w");
+	Uint32 f,first;
+	int i;
+	if(fp == NULL)
+		return -1;
+	fprintf(fp,"frame");
+	for(i = 0; i < PROF_STAGES;i++)
+		fprintf(fp,",%s_us",StageNames[i]);
+	fprintf(fp,"\n");
+	first = (Head - Frames) & (PROF_HISTORY-1);
+	for(f = 0; f < Frames;f++){
+		fprintf(fp,"%u",(unsigned)f);
+		for(i = 0; i < PROF_STAGES;i++)
+			fprintf(fp,",%u",(unsigned)History[i][(first + f) & (PROF_HISTORY-1)]);
+		fprintf(fp,"\n");
+	}
+	fclose(fp);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "light.h"
+
+/*
+	Per-stage frame profiler
+	- Build with PROFILE defined (make PROFILE=1) to turn it on,
+	  otherwise every PROF_* macro compiles to nothing
+	- Stages can be entered several times a frame, the time adds up
+	  and gets pushed into the history ring by PROF_FRAME_END(). Time
+	  whole loops rather than each iteration, two timer reads per quad
+	  cost more than what they measure
+*/
+
+enum {
+	PROF_TRANSFORM = 0,
+	PROF_LIGHTING,
+	PROF_BUMP,
+	PROF_HEADER,
+	PROF_SUBMIT,
+	PROF_WAIT,
+	PROF_UPLOAD,
+	PROF_FRAME,
+	PROF_STAGES
+};
+
+#define PROF_HISTORY 256
+
+#ifdef _arch_dreamcast
+#define PROF_CSV_PATH "/pc/profile.csv"
+#else
+#define PROF_CSV_PATH "profile.csv"
+#endif
+
+typedef struct {
+	Uint32 min,avg,max,p99;	// microseconds
+	Uint32 samples;
+}ProfStats;
+
+#ifdef PROFILE
+
+void Prof_Begin(int stage);
+void Prof_End(int stage);
+void Prof_Frame_End();
+void Prof_Get_Stats(int stage,ProfStats* out);
+void Prof_Draw_Overlay(int line);
+int Prof_Dump_CSV(const char* fn);
+
+#define PROF_BEGIN(s) Prof_Begin(s)
+#define PROF_END(s) Prof_End(s)
+#define PROF_FRAME_END() Prof_Frame_End()
+#define PROF_OVERLAY(line) Prof_Draw_Overlay(line)
+#define PROF_DUMP(fn) Prof_Dump_CSV(fn)
+
+#else
+
+#define PROF_BEGIN(s)
+#define PROF_END(s)
+#define PROF_FRAME_END()
+#define PROF_OVERLAY(line)
+#define PROF_DUMP(fn)
+
+#endif
+
+#endif
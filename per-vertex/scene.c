@@ -0,0 +1,406 @@
+/*
+	DSCN scenes, see scenefmt.h for the layout and tools/mkscene.c for
+	the text version
+	- Scene_Poll() rereads the file every SCENE_POLL_FRAMES frames and
+	  only applies the parts that differ, so lights can be tuned
+	  without restarting. Development builds only (SCENE_HOT_RELOAD)
+*/
+
+#include <kos.h>
+#include "scene.h"
+#include "anim.h"
+#include "ambient.h"
+#include "texture.h"
+#include "atlas.h"
+#include "shadow.h"
+
+static int Section_Ok(const SceneHeader* h,const SceneSection* sec,Uint32 size){
+	if(sec->count == 0)
+		return 1;
+	return (sec->offset & 3) == 0 && sec->offset >= sizeof(SceneHeader) && sec->offset <= h->size
+		&& sec->count <= (h->size - sec->offset) / size;
+}
+
+static int String_Ok(const SceneHeader* h,const Uint8* data,Uint32 off){
+	const char* str = (const char*)data + h->strings.offset;
+	Uint32 i;
+	for(i = off; i < h->strings.count;i++)
+		if(str[i] == 0)
+			return 1;
+	return 0;
+}
+
+/*
+	Everything Apply_Scene() and the accessors touch is checked here,
+	so nothing later has to bounds check
+*/
+static int Scene_Valid(const Uint8* data,Uint32 len){
+	const SceneHeader* h = (const SceneHeader*)data;
+	const SceneTexture* tex;
+	const SceneTile* tile;
+	Uint32 i,quads = 0;
+
+	if(len < sizeof(SceneHeader) || memcmp(h->id,"DSCN",4) != 0 || h->version != SCENE_VERSION
+		|| h->size != len)
+		return 0;
+	if(h->up[0] == 0.0f && h->up[1] == 0.0f && h->up[2] == 0.0f)
+		return 0;
+	if(!Section_Ok(h,&h->textures,sizeof(SceneTexture)) || !Section_Ok(h,&h->tiles,sizeof(SceneTile))
+		|| !Section_Ok(h,&h->lights,sizeof(SceneLight)) || !Section_Ok(h,&h->occluders,sizeof(SceneOccluder))
+		|| !Section_Ok(h,&h->strings,1))
+		return 0;
+	if(h->grid_w * h->grid_h != h->tiles.count || h->textures.count >= SCENE_NONE)
+		return 0;
+	tex = (const SceneTexture*)(data + h->textures.offset);
+	for(i = 0; i < h->textures.count;i++){
+		if(!String_Ok(h,data,tex[i].path))
+			return 0;
+		if(tex[i].region != SCENE_NO_STRING && !String_Ok(h,data,tex[i].region))
+			return 0;
+	}
+	tile = (const SceneTile*)(data + h->tiles.offset);
+	for(i = 0; i < h->tiles.count;i++){
+		if(tile[i].texture != SCENE_NONE && tile[i].texture >= h->textures.count)
+			return 0;
+		if(tile[i].bumpmap != SCENE_NONE && tile[i].bumpmap >= h->textures.count)
+			return 0;
+		quads += tile[i].texture != SCENE_NONE;
+	}
+	/*
+		A layer that doesn't fit is turned down rather than cut short,
+		so every build draws the same tiles from the same file
+	*/
+	if(quads > MAX_LAYER_SIZE){
+		printf("scene: %u tiles, the layer holds %d\n",(unsigned)quads,MAX_LAYER_SIZE);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+	The fixup pass, texture references become cache entries and atlas
+	regions become UVs
+*/
+static void Resolve_Textures(Scene* s){
+	const SceneTexture* tex = Scene_Section(s,textures,SceneTexture);
+	char path[128];
+	Uint32 i;
+	for(i = 0; i < s->hdr->textures.count;i++){
+		SceneTextureRef* r = &s->textures[i];
+		const char* fn = Scene_String(s,tex[i].path);
+		snprintf(path,sizeof(path),"%s%s",fn[0] == '/' ? "" : ROMDISK_PATH,fn);
+		r->tex = Tex_Acquire(path);
+		r->u0 = 0.0f;
+		r->v0 = 0.0f;
+		r->u1 = 1.0f;
+		r->v1 = 1.0f;
+		if(tex[i].region != SCENE_NO_STRING){
+			Atlas a;
+			const AtlasRegion* reg;
+			if(Load_Atlas(path,&a) == 0){
+				reg = Atlas_Find(&a,Scene_String(s,tex[i].region));
+				if(reg){
+					r->u0 = reg->u0;
+					r->v0 = reg->v0;
+					r->u1 = reg->u1;
+					r->v1 = reg->v1;
+				}
+				Free_Atlas(&a);
+			}
+		}
+	}
+}
+
+Uint32 LightsDirty = 0;
+int LightsBaked = 0;
+
+static Uint32 Scene_Hash(const Uint8* data,Uint32 len){
+	Uint32 h = 2166136261u;
+	while(len--)
+		h = (h ^ *data++) * 16777619u;
+	return h;
+}
+
+/*
+	One read of the whole file
+*/
+static Uint8* Read_File(const char* fn,Uint32* len){
+	Uint8* data = NULL;
+	FILE* fp = fopen(fn,"rb");
+	long n;
+	if(fp == NULL)
+		return NULL;
+	fseek(fp,0,SEEK_END);
+	n = ftell(fp);
+	fseek(fp,0,SEEK_SET);
+	if(n > 0)
+		data = malloc(n);
+	if(data && fread(data,n,1,fp) != 1){
+		free(data);
+		data = NULL;
+	}
+	fclose(fp);
+	*len = n;
+	return data;
+}
+
+/*
+	Validation and fixups, the scene owns data afterwards even if it
+	turns out to be bad
+*/
+static int Scene_From_Data(Scene* s,Uint8* data,Uint32 len){
+	s->data = data;
+	s->hdr = NULL;
+	s->textures = NULL;
+	if(data == NULL || !Scene_Valid(data,len)){
+		Free_Scene(s);
+		return -1;
+	}
+	s->hash = Scene_Hash(data,len);
+	s->hdr = (const SceneHeader*)s->data;
+	s->textures = malloc((s->hdr->textures.count + 1) * sizeof(SceneTextureRef));
+	if(s->textures == NULL){
+		Free_Scene(s);
+		return -1;
+	}
+	Resolve_Textures(s);
+	return 0;
+}
+
+int Load_Scene(const char* fn,Scene* s){
+	Uint32 len;
+	Uint8* data = Read_File(fn,&len);
+	return Scene_From_Data(s,data,len);
+}
+
+static void Apply_Layer(const Scene* s){
+	const SceneHeader* h = s->hdr;
+	const SceneTile* tile = Scene_Section(s,tiles,SceneTile);
+	Uint32 x,y;
+
+	LayerSize = 0;
+	for(y = 0; y < h->grid_h;y++){
+		for(x = 0; x < h->grid_w;x++){
+			const SceneTile* t = &tile[y*h->grid_w + x];
+			const SceneTextureRef* r;
+			Quad* qd;
+			if(t->texture == SCENE_NONE)
+				continue;
+			r = &s->textures[t->texture];
+			qd = &Layer[LayerSize++];
+			Init_Quad_UV(qd,x*h->tile_w,y*h->tile_h,h->z,h->tile_w,h->tile_h,r->u0,r->v0,r->u1,r->v1);
+			qd->mat.texture = r->tex;
+			qd->mat.bumpmap = t->bumpmap == SCENE_NONE ? NULL : s->textures[t->bumpmap].tex;
+			qd->mat.bumpmapped = t->bumpmap != SCENE_NONE;
+		}
+	}
+	Sort_Layer();
+}
+
+void Scene_Light(const SceneLight* sl,Light* l){
+	l->x = sl->x;
+	l->y = sl->y;
+	l->z = sl->z;
+	l->w = 1.0;
+	l->ac = sl->ac;
+	l->ab = sl->ab;
+	l->aa = sl->aa;
+	l->dummy = 1.0;
+	l->r = sl->r;
+	l->g = sl->g;
+	l->b = sl->b;
+	l->a = sl->a;
+	l->radius = sl->radius;
+	l->flags = sl->flags & SCENE_LIGHT_DYNAMIC ? LIGHT_DYNAMIC : 0;
+}
+
+static void Apply_Occluders(const Scene* s){
+	const SceneOccluder* occ = Scene_Section(s,occluders,SceneOccluder);
+	Uint32 i;
+	Clear_Occluders();
+	for(i = 0; i < s->hdr->occluders.count;i++)
+		Add_Occluder(occ[i].x1,occ[i].y1,occ[i].x2,occ[i].y2);
+	Build_Occluder_Grid();
+}
+
+static void Apply_Ambient(const Scene* s){
+	const SceneHeader* h = s->hdr;
+	Vector3 sky = {h->sky[0],h->sky[1],h->sky[2],0};
+	Vector3 ground = {h->ground[0],h->ground[1],h->ground[2],0};
+	Vector3 up = {h->up[0],h->up[1],h->up[2],0};
+	Ambient_Set(h->ambient[0],h->ambient[1],h->ambient[2]);
+	Ambient_Hemisphere(&sky,&ground,&up);
+}
+
+void Apply_Scene(const Scene* s){
+	const SceneLight* sl = Scene_Section(s,lights,SceneLight);
+	int i;
+
+	Apply_Layer(s);
+	LightsBaked = 0;
+	Light_Anim_Reset();
+	LIGHTS = MIN(s->hdr->lights.count,MAX_LIGHTS);
+	for(i = 0; i < LIGHTS;i++)
+		Scene_Light(&sl[i],&Lights[i]);
+	LightsDirty = (1u << LIGHTS) - 1;
+	Apply_Occluders(s);
+	Apply_Ambient(s);
+}
+
+static void Clear_Bake(){
+	int i,j;
+	for(i = 0; i < LayerSize;i++){
+		for(j = 0; j < 4;j++){
+			Vertex* v = &Layer[i].verts[j];
+			v->c.x = v->c.y = v->c.z = 0.0f;
+			v->FinalColor = v->c;
+		}
+	}
+	LightsBaked = 0;
+	Ambient_Invalidate();
+}
+
+/*
+	Baked colours go into each vertex's c, which Draw_Quad() resets
+	FinalColor to (plus Quad.base) every frame. The bake has to come from the same
+	scene file, after Apply_Scene()
+*/
+int Load_Bake(const char* fn,const Scene* s){
+	const BakeHeader* h;
+	const BakeColor* col;
+	Uint32 len;
+	Uint8* data = Read_File(fn,&len);
+	int i,j;
+
+	if(data == NULL)
+		return -1;
+	h = (const BakeHeader*)data;
+	if(len < sizeof(BakeHeader) || memcmp(h->id,"DCOL",4) != 0 || h->version != BAKE_VERSION
+		|| h->scene_hash != s->hash || h->quads != (Uint32)LayerSize
+		|| len < sizeof(BakeHeader) + h->quads*4*sizeof(BakeColor)){
+		free(data);
+		return -1;
+	}
+	col = (const BakeColor*)(h + 1);
+	for(i = 0; i < LayerSize;i++){
+		for(j = 0; j < 4;j++,col++){
+			Vertex* v = &Layer[i].verts[j];
+			v->c.x = col->r;
+			v->c.y = col->g;
+			v->c.z = col->b;
+			v->FinalColor = v->c;
+		}
+	}
+	free(data);
+	LightsBaked = 1;
+	for(i = 0; i < LIGHTS;i++)
+		if(!(Lights[i].flags & LIGHT_DYNAMIC))
+			Light_Anim_Stop(i);
+	Ambient_Invalidate();
+	return 0;
+}
+
+static int Same_Section(const Scene* a,const Scene* b,const SceneSection* sa,const SceneSection* sb,Uint32 size){
+	return sa->count == sb->count && memcmp(a->data + sa->offset,b->data + sb->offset,sa->count * size) == 0;
+}
+
+/*
+	Applies only what differs between cur and next, then next replaces
+	cur. Lights that change are flagged in LightsDirty and stop
+	animating, animated lights the file left alone keep going. The
+	layer, occluder grid and ambient are only redone when their part
+	of the file changed
+*/
+int Update_Scene(Scene* cur,Scene* next){
+	const SceneHeader* a = cur->hdr;
+	const SceneHeader* b = next->hdr;
+	const SceneLight* la = Scene_Section(cur,lights,SceneLight);
+	const SceneLight* lb = Scene_Section(next,lights,SceneLight);
+	int changes = 0;
+	Uint32 i;
+
+	if(a->grid_w != b->grid_w || a->grid_h != b->grid_h || a->tile_w != b->tile_w || a->tile_h != b->tile_h
+		|| a->z != b->z || !Same_Section(cur,next,&a->tiles,&b->tiles,sizeof(SceneTile))
+		|| a->textures.count != b->textures.count
+		|| memcmp(cur->textures,next->textures,a->textures.count * sizeof(SceneTextureRef)) != 0){
+		Apply_Layer(next);
+		changes |= SCENE_CHANGED_LAYER;
+	}
+	for(i = 0; i < b->lights.count && i < MAX_LIGHTS;i++){
+		if(i < a->lights.count && memcmp(&la[i],&lb[i],sizeof(SceneLight)) == 0)
+			continue;
+		Light_Anim_Stop(i);
+		Scene_Light(&lb[i],&Lights[i]);
+		LightsDirty |= 1u << i;
+		changes |= SCENE_CHANGED_LIGHTS;
+	}
+	if(a->lights.count != b->lights.count){
+		for(i = b->lights.count; i < a->lights.count && i < MAX_LIGHTS;i++)
+			Light_Anim_Stop(i);
+		LIGHTS = MIN(b->lights.count,MAX_LIGHTS);
+		changes |= SCENE_CHANGED_LIGHTS;
+	}
+	if(!Same_Section(cur,next,&a->occluders,&b->occluders,sizeof(SceneOccluder))){
+		Apply_Occluders(next);
+		changes |= SCENE_CHANGED_OCCLUDERS;
+	}
+	if(memcmp(a->ambient,b->ambient,sizeof(a->ambient)) != 0 || memcmp(a->sky,b->sky,sizeof(a->sky)) != 0
+		|| memcmp(a->ground,b->ground,sizeof(a->ground)) != 0 || memcmp(a->up,b->up,sizeof(a->up)) != 0){
+		Apply_Ambient(next);
+		changes |= SCENE_CHANGED_AMBIENT;
+	}
+	/*
+		The bake is for the old file, light everything at runtime
+		until there's a new one. Ambient goes on top of the bake in
+		Quad.base so it keeps it
+	*/
+	if((changes & ~SCENE_CHANGED_AMBIENT) && LightsBaked)
+		Clear_Bake();
+	Free_Scene(cur);
+	*cur = *next;
+	return changes;
+}
+
+#ifdef SCENE_HOT_RELOAD
+/*
+	Call once a frame, returns the SCENE_CHANGED_* bits for what got
+	reloaded. The file is small so it's simply reread and hashed,
+	which also works over dc-tool's /pc where there's no mtime
+*/
+int Scene_Poll(Scene* s,const char* fn){
+	static int frame = 0;
+	Scene next;
+	Uint8* data;
+	Uint32 len;
+
+	if(++frame < SCENE_POLL_FRAMES || s->hdr == NULL)
+		return 0;
+	frame = 0;
+	data = Read_File(fn,&len);
+	if(data == NULL)
+		return 0;
+	if(Scene_Hash(data,len) == s->hash){
+		free(data);
+		return 0;
+	}
+	if(Scene_From_Data(&next,data,len) != 0){
+		/*
+			Half written or broken, try again next time round
+		*/
+		return 0;
+	}
+	return Update_Scene(s,&next);
+}
+#endif
+
+void Free_Scene(Scene* s){
+	Uint32 i;
+	if(s->textures && s->hdr)
+		for(i = 0; i < s->hdr->textures.count;i++)
+			Tex_Unref(s->textures[i].tex);
+	free(s->textures);
+	free(s->data);
+	s->textures = NULL;
+	s->data = NULL;
+	s->hdr = NULL;
+}
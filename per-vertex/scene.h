@@ -0,0 +1,76 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "light.h"
+#include "scenefmt.h"
+
+/*
+	Scene loading
+	- Load_Scene() reads a DSCN file in one go, checks every offset and
+	  resolves its textures through the cache. Scenes with more tiles
+	  than MAX_LAYER_SIZE are turned down, not cut short
+	- Apply_Scene() builds the layer, lights, occluder grid and the
+	  ambient and hemisphere colours from it, the file stays loaded so
+	  it can be applied again
+	- Scene_Poll() hot reloads it, from the PC over dc-tool on the
+	  Dreamcast or straight from romdisk/ on the host, so
+	  make -f Makefile.host scenes (or mkscene) while it runs. Only in
+	  builds with SCENE_HOT_RELOAD (make HOT_RELOAD=1), otherwise it
+	  does nothing and never touches the file
+	- Load_Bake() seeds the vertex colours with the static lights from
+	  a DCOL file, those lights are then skipped at runtime until the
+	  scene changes
+*/
+
+#define SCENE_POLL_FRAMES 30
+
+#ifdef _arch_dreamcast
+#define SCENE_RELOAD_PATH "/pc/romdisk/"
+#else
+#define SCENE_RELOAD_PATH "romdisk/"
+#endif
+
+enum {
+	SCENE_CHANGED_LAYER = 1,
+	SCENE_CHANGED_LIGHTS = 2,
+	SCENE_CHANGED_OCCLUDERS = 4,
+	SCENE_CHANGED_AMBIENT = 8
+};
+
+typedef struct {
+	Texture* tex;
+	float u0,v0,u1,v1;
+}SceneTextureRef;
+
+typedef struct {
+	Uint8* data;
+	const SceneHeader* hdr;
+	SceneTextureRef* textures;	// one per SceneTexture
+	Uint32 hash;	// of the file, to spot changes
+}Scene;
+
+/*
+	Bit per light, set when Apply_Scene(), a reload, a command or a
+	path animation changes where it is or how it falls off. Colour
+	alone needs no bit. Whoever caches per-light work clears the bits
+	it has dealt with
+*/
+extern Uint32 LightsDirty;
+extern int LightsBaked;	// static lights are in the vertex colours
+
+int Load_Scene(const char* fn,Scene* s);
+void Apply_Scene(const Scene* s);
+void Scene_Light(const SceneLight* sl,Light* l);
+int Load_Bake(const char* fn,const Scene* s);
+int Update_Scene(Scene* cur,Scene* next);
+#ifdef SCENE_HOT_RELOAD
+int Scene_Poll(Scene* s,const char* fn);
+#else
+#define Scene_Poll(s,fn) 0
+#endif
+void Free_Scene(Scene* s);
+
+#define Scene_Section(s,sec,type) ((const type*)((s)->data + (s)->hdr->sec.offset))
+#define Scene_String(s,off) ((const char*)((s)->data + (s)->hdr->strings.offset + (off)))
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef SCENEFMT_H
+#define SCENEFMT_H
+
+/*
+	DSCN binary scene layout, shared with tools/mkscene.c so it only
+	uses plain C types
+	- Little endian (SH4 and x86 both are), every section 4 byte
+	  aligned so the file is used in place after one read
+	- Everything refers to everything else by offset or index, never
+	  by pointer
+*/
+
+#define SCENE_VERSION 2
+#define SCENE_NONE 0xffff	// no texture / bumpmap on a tile
+#define SCENE_NO_STRING 0xffffffff
+#define SCENE_LIGHT_DYNAMIC 1
+
+typedef struct {
+	unsigned int offset;	// from the start of the file
+	unsigned int count;	// entries, bytes for the string table
+}SceneSection;
+
+typedef struct {
+	char id[4];	// 'DSCN'
+	unsigned int version;
+	unsigned int size;	// whole file
+	unsigned int grid_w,grid_h;	// tiles
+	float tile_w,tile_h;	// pixels
+	float z;
+	float ambient[3];	// global ambient, see ambient.h
+	float sky[3],ground[3];	// hemisphere colours
+	float up[3];	// towards the sky, not unit length in the file
+	SceneSection textures;	// SceneTexture
+	SceneSection tiles;	// SceneTile, grid_w*grid_h row by row
+	SceneSection lights;	// SceneLight
+	SceneSection occluders;	// SceneOccluder
+	SceneSection strings;	// NUL terminated, referenced by offset
+}SceneHeader;
+
+typedef struct {
+	unsigned int path;	// string, relative paths are under the romdisk
+	unsigned int region;	// atlas region name or SCENE_NO_STRING
+}SceneTexture;
+
+typedef struct {
+	unsigned short texture;	// SceneTexture index, SCENE_NONE leaves a hole
+	unsigned short bumpmap;	// SCENE_NONE for no bump pass
+}SceneTile;
+
+typedef struct {
+	float x,y,z;
+	float ac,ab,aa;	// constant, linear, quadratic attenuation
+	float r,g,b,a;
+	float radius;	// 0 = unbounded
+	unsigned int flags;	// SCENE_LIGHT_DYNAMIC
+}SceneLight;
+
+typedef struct {
+	float x1,y1,x2,y2;
+}SceneOccluder;
+
+/*
+	DCOL baked vertex colours from host/bake.c, the header is followed
+	by quads*4 BakeColor in the order Apply_Scene() builds the layer
+*/
+#define BAKE_VERSION 1
+
+typedef struct {
+	char id[4];	// 'DCOL'
+	unsigned int version;
+	unsigned int scene_hash;	// of the DSCN file it was baked from
+	unsigned int quads;
+}BakeHeader;
+
+typedef struct {
+	float r,g,b;
+}BakeColor;
+
+#endif
@@ -0,0 +1,130 @@
+/*
+	Occluder grid and light visibility test
+	- Segments are binned into every grid cell their bounding box touches
+	- Rays are walked cell by cell from the vertex towards the light
+*/
+
+#include <kos.h>
+#include <math.h>
+#include "shadow.h"
+#include "kernels.h"
+
+#define SHADOW_EPS 0.0001f
+
+int SHADOWS = 0;
+int OccluderCount = 0;
+Occluder Occluders[MAX_OCCLUDERS];
+
+static OccluderCell Grid[OCC_GRID_W*OCC_GRID_H];
+
+static inline int Cell_Clamp(float v,int max){
+	int c = (int)(v / TILE);
+	if(v < 0.0f) c = 0;
+	if(c >= max) c = max - 1;
+	return c;
+}
+
+void Clear_Occluders(){
+	OccluderCount = 0;
+	memset(Grid,0,sizeof(Grid));
+	Light_Cache_Invalidate();
+}
+
+int Add_Occluder(float x1,float y1,float x2,float y2){
+	if(OccluderCount == MAX_OCCLUDERS)
+		return -1;
+	Occluders[OccluderCount].x1 = x1;
+	Occluders[OccluderCount].y1 = y1;
+	Occluders[OccluderCount].x2 = x2;
+	Occluders[OccluderCount].y2 = y2;
+	return OccluderCount++;
+}
+
+/*
+	Call after the occluder set changes
+*/
+void Build_Occluder_Grid(){
+	int i,cx,cy;
+	memset(Grid,0,sizeof(Grid));
+	for(i = 0; i < OccluderCount;i++){
+		Occluder* o = &Occluders[i];
+		int x0 = Cell_Clamp(MIN(o->x1,o->x2),OCC_GRID_W);
+		int x1 = Cell_Clamp(MAX(o->x1,o->x2),OCC_GRID_W);
+		int y0 = Cell_Clamp(MIN(o->y1,o->y2),OCC_GRID_H);
+		int y1 = Cell_Clamp(MAX(o->y1,o->y2),OCC_GRID_H);
+		for(cy = y0; cy <= y1;cy++){
+			for(cx = x0; cx <= x1;cx++){
+				OccluderCell* c = &Grid[cy*OCC_GRID_W + cx];
+				if(c->count < MAX_CELL_OCCLUDERS)
+					c->items[c->count++] = i;
+			}
+		}
+	}
+}
+
+/*
+	Does the ray p + t*d (0 < t < 1) cross the occluder?
+	End points are excluded so vertices sitting on a wall still get lit.
+*/
+static inline int Segment_Blocks(const Occluder* o,float px,float py,float dx,float dy){
+	float ex = o->x2 - o->x1;
+	float ey = o->y2 - o->y1;
+	float denom = dx*ey - dy*ex;
+	if(fabsf(denom) < SHADOW_EPS)
+		return 0;
+	float ax = o->x1 - px;
+	float ay = o->y1 - py;
+	float inv = 1.0f / denom;
+	float t = (ax*ey - ay*ex) * inv;
+	float u = (ax*dy - ay*dx) * inv;
+	return t > SHADOW_EPS && t < 1.0f - SHADOW_EPS && u >= 0.0f && u <= 1.0f;
+}
+
+/*
+	Walks the grid from the vertex to the light (Amanatides & Woo)
+	and tests the occluders in each cell it passes through
+*/
+int Light_Visible(const Light* l,float x,float y){
+	float dx = l->x - x;
+	float dy = l->y - y;
+	int cx = Cell_Clamp(x,OCC_GRID_W);
+	int cy = Cell_Clamp(y,OCC_GRID_H);
+	int ex = Cell_Clamp(l->x,OCC_GRID_W);
+	int ey = Cell_Clamp(l->y,OCC_GRID_H);
+	int stepx = dx > 0.0f ? 1 : -1;
+	int stepy = dy > 0.0f ? 1 : -1;
+	float tmaxx = 2.0f,tmaxy = 2.0f;
+	float tdx = 2.0f,tdy = 2.0f;
+	int i;
+
+	if(dx != 0.0f){
+		tdx = TILE / fabsf(dx);
+		tmaxx = ((cx + (stepx > 0)) * TILE - x) / dx;
+	}
+	if(dy != 0.0f){
+		tdy = TILE / fabsf(dy);
+		tmaxy = ((cy + (stepy > 0)) * TILE - y) / dy;
+	}
+
+	for(;;){
+		OccluderCell* c = &Grid[cy*OCC_GRID_W + cx];
+		for(i = 0; i < c->count;i++){
+			if(Segment_Blocks(&Occluders[c->items[i]],x,y,dx,dy))
+				return 0;
+		}
+		if(cx == ex && cy == ey)
+			break;
+		if(tmaxx < tmaxy){
+			if(tmaxx > 1.0f) break;
+			cx += stepx;
+			tmaxx += tdx;
+		}else{
+			if(tmaxy > 1.0f) break;
+			cy += stepy;
+			tmaxy += tdy;
+		}
+		if(cx < 0 || cy < 0 || cx >= OCC_GRID_W || cy >= OCC_GRID_H)
+			break;
+	}
+	return 1;
+}
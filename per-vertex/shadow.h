@@ -0,0 +1,54 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include "light.h"
+
+/*
+	CPU visibility test for the lighting pass.
+	Occluders are 2D wall segments in the same space as the transformed
+	vertices. They get binned into a uniform grid of TILE sized cells so a
+	light/vertex ray only has to look at the cells it walks through.
+*/
+
+#define MAX_OCCLUDERS 64
+#define MAX_CELL_OCCLUDERS 16
+#define OCC_GRID_W (640/TILE)
+#define OCC_GRID_H ((480/TILE) + 1)
+
+typedef struct {
+	float x1,y1;
+	float x2,y2;
+}Occluder;
+
+typedef struct {
+	Uint8 count;
+	Uint8 items[MAX_CELL_OCCLUDERS];
+}OccluderCell;
+
+extern int SHADOWS;
+extern int OccluderCount;
+extern Occluder Occluders[MAX_OCCLUDERS];
+
+void Clear_Occluders();
+int Add_Occluder(float x1,float y1,float x2,float y2);
+void Build_Occluder_Grid();
+int Light_Visible(const Light* l,float x,float y);
+
+/*
+	Returns 0 if the light can't reach the point, either because it is
+	outside the light's radius or because an occluder is in the way.
+	The radius test runs first so the grid walk only happens in range.
+*/
+static inline int Light_Reaches(const Light* l,float x,float y){
+	if(l->radius > 0.0f){
+		float dx = l->x - x;
+		float dy = l->y - y;
+		if(dx*dx + dy*dy > l->radius*l->radius)
+			return 0;
+	}
+	if(SHADOWS && OccluderCount)
+		return Light_Visible(l,x,y);
+	return 1;
+}
+
+#endif
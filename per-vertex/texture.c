@@ -0,0 +1,1094 @@
+/*
+	DTEX texture loading
+	- Mapped files go straight from the mapping to VRAM with no RAM copy
+	- Unmappable files stream through a small chunk buffer
+	- DTEZ files (a DTEX header, then the payload zlib compressed) are
+	  inflated a chunk at a time into the same upload path
+	- Palettes are loaded from "<file>.pal" next to paletted textures
+	- Headers are checked against the size their format needs (twiddled,
+	  stride, VQ, mipmapped) before any VRAM is handed out
+	- Tex_Request() does the same in the background, and the cache at
+	  the bottom of the file shares textures by path
+*/
+
+#include <kos.h>
+#include <zlib.h>
+#include "texture.h"
+#include "palette.h"
+
+#ifndef _arch_dreamcast
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+TexLoadStats TexStats;
+
+static Uint8 Chunk[TEX_CHUNK] __attribute__((aligned(32)));
+static Uint8 ZIn[TEX_CHUNK];
+
+/*
+	File access, fs_mmap only works for romdisk files on the Dreamcast
+	(they're already in RAM), the host can mmap anything
+*/
+typedef struct {
+#ifdef _arch_dreamcast
+	file_t fd;
+#else
+	int fd;
+	void* map;
+	size_t size;
+#endif
+}TexFile;
+
+static int Tex_Open(TexFile* f,const char* fn){
+#ifdef _arch_dreamcast
+	f->fd = fs_open(fn,O_RDONLY);
+	return f->fd == FILEHND_INVALID ? -1 : 0;
+#else
+	struct stat st;
+	f->map = NULL;
+	f->fd = open(fn,O_RDONLY);
+	if(f->fd < 0)
+		return -1;
+	f->size = fstat(f->fd,&st) == 0 ? (size_t)st.st_size : 0;
+	return 0;
+#endif
+}
+
+static const Uint8* Tex_Map(TexFile* f){
+#ifdef _arch_dreamcast
+	return (const Uint8*)fs_mmap(f->fd);
+#else
+	if(f->size == 0)
+		return NULL;
+	f->map = mmap(NULL,f->size,PROT_READ,MAP_PRIVATE,f->fd,0);
+	if(f->map == MAP_FAILED)
+		f->map = NULL;
+	return (const Uint8*)f->map;
+#endif
+}
+
+static Uint32 Tex_Size(TexFile* f){
+#ifdef _arch_dreamcast
+	return fs_total(f->fd);
+#else
+	return f->size;
+#endif
+}
+
+/*
+	Pipes and the like hand back short reads on the host, keeps going
+	until n bytes or the end of the file
+*/
+static int Tex_Read(TexFile* f,void* buf,Uint32 n){
+#ifdef _arch_dreamcast
+	return fs_read(f->fd,buf,n);
+#else
+	Uint32 got = 0;
+	ssize_t r;
+	while(got < n && (r = read(f->fd,(Uint8*)buf + got,n - got)) > 0)
+		got += r;
+	return got > 0 || n == 0 ? (int)got : -1;
+#endif
+}
+
+static void Tex_Close(TexFile* f){
+#ifdef _arch_dreamcast
+	fs_close(f->fd);
+#else
+	if(f->map)
+		munmap(f->map,f->size);
+	close(f->fd);
+#endif
+}
+
+static int Tex_Compressed(const header_t* hdr){
+	return memcmp(hdr->id,"DTEZ",4) == 0;
+}
+
+static int Pow2(int n){
+	return n >= 8 && n <= 1024 && (n & (n - 1)) == 0;
+}
+
+/*
+	Bytes of texel data the format needs, 0 if the PVR can't use it.
+	VQ is a 256 entry codebook of 8 byte entries (2x2 texels at 16bpp,
+	4x2 at 8bpp, 4x4 at 4bpp) followed by one byte index per entry,
+	VQ and paletted textures are always twiddled. Mipmaps are stored
+	smallest first after a few bytes of padding
+*/
+static Uint32 Tex_Format_Size(const header_t* hdr,Uint32* plain){
+	Uint32 fmt = hdr->type;
+	int pf = (fmt >> 27) & 7;
+	int bits = pf == 5 ? 4 : (pf == 6 ? 8 : 16);
+	int vq = (fmt & PVR_TXRFMT_VQ_ENABLE) != 0;
+	int mip = (fmt & TEX_FMT_MIPMAP) != 0;
+	int nontwiddled = pf < 5 && (fmt & PVR_TXRFMT_NONTWIDDLED);
+	Uint32 texels,size;
+	int w;
+
+	if(pf == 7 || !Pow2(hdr->height))
+		return 0;
+	if(nontwiddled){
+		/*
+			Strided textures are the only ones that can have any
+			width, in steps of 32
+		*/
+		if(vq || mip)
+			return 0;
+		if(pf < 5 && (fmt & PVR_TXRFMT_STRIDE)){
+			if(hdr->width < 32 || hdr->width > 1024 || (hdr->width & 31))
+				return 0;
+		}else if(!Pow2(hdr->width)){
+			return 0;
+		}
+	}else if(!Pow2(hdr->width) || (mip && hdr->width != hdr->height)){
+		return 0;
+	}
+
+	texels = hdr->width*hdr->height;
+	if(mip)
+		for(w = hdr->width >> 1; w > 0;w >>= 1)
+			texels += w*w;
+	*plain = texels*bits/8;
+	if(!vq)
+		return *plain + (mip ? (bits == 16 ? 6 : 3) : 0);
+	size = texels*bits/64;
+	if(mip)
+		size += hdr->width > 2 ? 1 : 0;
+	return 2048 + size;
+}
+
+/*
+	texconv rounds the payload up to 32 bytes
+*/
+static int Tex_Valid(const header_t* hdr){
+	Uint32 plain,need;
+	if((memcmp(hdr->id,"DTEX",4) != 0 && !Tex_Compressed(hdr)) || hdr->size <= 0)
+		return 0;
+	need = Tex_Format_Size(hdr,&plain);
+	return need != 0 && (Uint32)hdr->size >= need && (Uint32)hdr->size <= ((need + 31) & ~31);
+}
+
+/*
+	DTEZ payloads, the header's size is the inflated size and the zlib
+	stream runs to the end of the file. Input comes straight from the
+	mapping when there is one, otherwise it's read into "in" a chunk
+	at a time
+*/
+typedef struct {
+	z_stream s;
+	TexFile* f;
+	Uint8* in;
+}TexZ;
+
+static int Z_Begin(TexZ* z,TexFile* f,const Uint8* map,Uint32 len,Uint8* in){
+	memset(&z->s,0,sizeof(z_stream));
+	z->f = f;
+	z->in = map ? NULL : in;
+	z->s.next_in = (Bytef*)map;
+	z->s.avail_in = map ? len : 0;
+	return inflateInit(&z->s) == Z_OK ? 0 : -1;
+}
+
+static int Z_Read(TexZ* z,Uint8* out,Uint32 n){
+	int r,got;
+	z->s.next_out = out;
+	z->s.avail_out = n;
+	while(z->s.avail_out > 0){
+		if(z->s.avail_in == 0 && z->in){
+			got = Tex_Read(z->f,z->in,TEX_CHUNK);
+			if(got <= 0)
+				return -1;
+			z->s.next_in = z->in;
+			z->s.avail_in = got;
+		}
+		r = inflate(&z->s,Z_NO_FLUSH);
+		if(r == Z_STREAM_END)
+			return z->s.avail_out == 0 ? 0 : -1;
+		if(r != Z_OK)
+			return -1;
+	}
+	return 0;
+}
+
+static void Z_End(TexZ* z){
+	inflateEnd(&z->s);
+}
+
+/*
+	Inflates into the chunk buffer and SQ copies each chunk to VRAM
+*/
+static int Z_Upload(TexZ* z,Texture* t,int size){
+	int off,n;
+	for(off = 0; off < size;off += n){
+		n = MIN(size - off,TEX_CHUNK);
+		if(Z_Read(z,Chunk,n) != 0)
+			return -1;
+		pvr_txr_load(Chunk,(Uint8*)t->txt + off,n);
+	}
+	return 0;
+}
+
+/*
+	Fills in the texture from its header and grabs the VRAM for it
+*/
+static int Tex_Setup(Texture* t,const header_t* hdr){
+	if(!Tex_Valid(hdr)){
+		TexStats.rejected++;
+		return -1;
+	}
+	t->w = hdr->width;
+	t->h = hdr->height;
+	t->fmt = hdr->type;
+	t->palette = 0;
+	t->size = hdr->size;
+	Tex_Cache_Make_Room(hdr->size);
+	t->txt = pvr_mem_malloc(hdr->size);
+	/*
+		Free space can be fragmented, keep evicting until it fits
+	*/
+	while(t->txt == NULL && Tex_Cache_Make_Room(0xffffffff))
+		t->txt = pvr_mem_malloc(hdr->size);
+	return t->txt == NULL ? -1 : 0;
+}
+
+static void Tex_Count(const Texture* t,int mapped){
+	Uint32 plain;
+	header_t hdr;
+	TexStats.loads++;
+	TexStats.bytes += t->size;
+	if(t->fmt & PVR_TXRFMT_VQ_ENABLE){
+		hdr.width = t->w;
+		hdr.height = t->h;
+		hdr.type = t->fmt;
+		Tex_Format_Size(&hdr,&plain);
+		TexStats.vq++;
+		if(plain > t->size)
+			TexStats.vq_saved += plain - t->size;
+	}
+	if(((t->fmt >> 27) & 7) >= 5 || !(t->fmt & PVR_TXRFMT_NONTWIDDLED))
+		TexStats.twiddled++;
+	if(mapped){
+		TexStats.mapped++;
+	}else{
+		TexStats.streamed++;
+		if(TexStats.scratch_peak < TEX_CHUNK)
+			TexStats.scratch_peak = TEX_CHUNK;
+	}
+}
+
+/*
+	Paletted textures come with "<file>.pal", a pal_header_t and then
+	numcolors ARGB8888 entries. Returns how many went into colors, -1
+	when the format has no palette or the file isn't there
+*/
+static int Read_Palette(const char* fn,int fmt,Uint32* colors){
+	pal_header_t phdr;
+	char pf[72];
+	FILE* fp;
+	int pf_type = (fmt >> 27) & 7;
+	int bpp8;
+
+	if(pf_type != 5 && pf_type != 6)
+		return -1;
+	bpp8 = pf_type == 6;
+	if(strlen(fn) + 5 > sizeof(pf))
+		return -1;
+	strcpy(pf,fn);
+	strcat(pf,".pal");
+	fp = fopen(pf,"r");
+	if(fp == NULL)
+		return -1;
+	if(fread(&phdr,sizeof(pal_header_t),1,fp) != 1 || memcmp(phdr.id,"DPAL",4) != 0
+		|| phdr.numcolors < 0 || phdr.numcolors > (bpp8 ? 256 : 16)
+		|| fread(colors,sizeof(Uint32),phdr.numcolors,fp) != (size_t)phdr.numcolors){
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return phdr.numcolors;
+}
+
+/*
+	Palette banks are main thread only
+*/
+static void Apply_Palette(Texture* t,const Uint32* colors,int count){
+	int slot;
+	if(count < 0)
+		return;
+	slot = Pal_Acquire(colors,count,((t->fmt >> 27) & 7) == 6);
+	if(slot < 0)
+		return;
+	t->palette = slot + 1;
+	t->fmt |= Pal_Format(slot);
+}
+
+static void Load_Palette(const char* fn,Texture* t){
+	Uint32 colors[256];
+	Apply_Palette(t,colors,Read_Palette(fn,t->fmt,colors));
+}
+
+void DeleteTexture(Texture* t){
+	if(t->palette)
+		Pal_Release(t->palette - 1);
+	t->palette = 0;
+	t->fmt = 0;
+	if(t->txt)
+		pvr_mem_free(t->txt);
+	t->txt = NULL;
+	t->size = 0;
+}
+
+/*
+	Reads the texture a chunk at a time, each chunk is SQ copied to VRAM
+	before the next one is read
+*/
+int Load_Texture_Streamed(const char* fn,Texture* t){
+	TexFile f;
+	header_t hdr;
+	int off,n;
+
+	if(Tex_Open(&f,fn) != 0)
+		return -1;
+	if(Tex_Read(&f,&hdr,sizeof(hdr)) != sizeof(hdr) || Tex_Setup(t,&hdr) != 0){
+		Tex_Close(&f);
+		return -1;
+	}
+	if(Tex_Compressed(&hdr)){
+		TexZ z;
+		int ok = Z_Begin(&z,&f,NULL,0,ZIn) == 0 && Z_Upload(&z,t,hdr.size) == 0;
+		Z_End(&z);
+		Tex_Close(&f);
+		if(!ok){
+			DeleteTexture(t);
+			return -1;
+		}
+		Tex_Count(t,0);
+		TexStats.compressed++;
+		Load_Palette(fn,t);
+		return 0;
+	}
+	for(off = 0; off < hdr.size;off += n){
+		n = MIN(hdr.size - off,TEX_CHUNK);
+		if(Tex_Read(&f,Chunk,n) != n){
+			Tex_Close(&f);
+			DeleteTexture(t);
+			return -1;
+		}
+		pvr_txr_load(Chunk,(Uint8*)t->txt + off,n);
+	}
+	Tex_Close(&f);
+	Tex_Count(t,0);
+	Load_Palette(fn,t);
+	return 0;
+}
+
+/*
+	Uploads straight out of the file mapping when there is one,
+	otherwise falls back to streaming
+*/
+int Load_Texture(const char* fn,Texture* t){
+	TexFile f;
+	header_t hdr;
+	const Uint8* map;
+
+	if(Tex_Open(&f,fn) != 0)
+		return -1;
+	map = Tex_Map(&f);
+	if(map == NULL){
+		Tex_Close(&f);
+		return Load_Texture_Streamed(fn,t);
+	}
+	memcpy(&hdr,map,sizeof(hdr));
+	if(Tex_Size(&f) < sizeof(hdr) + (Tex_Compressed(&hdr) ? 0 : hdr.size) || Tex_Setup(t,&hdr) != 0){
+		Tex_Close(&f);
+		return -1;
+	}
+	if(Tex_Compressed(&hdr)){
+		TexZ z;
+		int ok = Z_Begin(&z,&f,map + sizeof(hdr),Tex_Size(&f) - sizeof(hdr),NULL) == 0
+			&& Z_Upload(&z,t,hdr.size) == 0;
+		Z_End(&z);
+		Tex_Close(&f);
+		if(!ok){
+			DeleteTexture(t);
+			return -1;
+		}
+		TexStats.compressed++;
+	}else{
+		pvr_txr_load((void*)(map + sizeof(hdr)),t->txt,hdr.size);
+		Tex_Close(&f);
+	}
+	Tex_Count(t,1);
+	Load_Palette(fn,t);
+	return 0;
+}
+
+void Tex_Print_Stats(){
+	printf("textures: %u loads (%u mapped, %u streamed, %u compressed), %u bytes, %u rejected\n",
+		(unsigned)TexStats.loads,(unsigned)TexStats.mapped,(unsigned)TexStats.streamed,
+		(unsigned)TexStats.compressed,(unsigned)TexStats.bytes,(unsigned)TexStats.rejected);
+	printf("textures: %u twiddled, %u VQ saving %u bytes of VRAM\n",
+		(unsigned)TexStats.twiddled,(unsigned)TexStats.vq,(unsigned)TexStats.vq_saved);
+}
+
+/*
+	Background streaming
+*/
+typedef struct {
+	int state;	// guarded by StreamLock
+	Uint32 seq;	// request order, the oldest goes first
+	Uint32 gen;	// bumped on reuse so stale handles can be told apart
+	char fn[64];
+	Texture* dst;
+	TexDone done;
+	void* user;
+	int reported;
+	/*
+		Filled in by the loader thread, owned by the main thread once
+		the state is TEX_READY and fetching is clear
+	*/
+	header_t hdr;
+	TexFile f;
+	int mapped;	// uploads straight from src
+	int chunked;	// uploads from the ring instead
+	int invalid;	// header failed Tex_Valid()
+	const Uint8* src;
+	Uint32* pal;	// read with the texture, applied once it's in
+	int pal_count;
+	Texture tex;
+	Uint32 off;
+	/*
+		Guarded by StreamLock
+	*/
+	int fetching;	// the loader thread still has it
+	int dropped;	// the main thread gave up, stop filling chunks
+	Uint32 filled;	// ring chunks the loader filled for it
+	Uint32 taken;	// and the main thread uploaded
+	Uint32 coff;	// into the chunk being uploaded
+}TexRequest;
+
+Texture TexFallback;
+Texture TexFallbackBump;
+
+static TexRequest Requests[TEX_MAX_REQUESTS];
+static Uint32 RequestSeq = 0;
+static mutex_t StreamLock;
+static condvar_t StreamCond;
+static kthread_t* Loader = NULL;
+static int StreamQuit = 0;
+
+/*
+	Whatever can't be uploaded straight from a mapping, plain reads
+	and anything compressed, passes through TEX_RING chunks. The loader
+	fills them in order and the main thread hands them back as it
+	uploads, requests use them oldest first on both sides
+*/
+static Uint8 Ring[TEX_RING][TEX_CHUNK] __attribute__((aligned(32)));
+static Uint32 RingLen[TEX_RING];
+static Uint32 RingHead = 0;	// chunks filled, guarded by StreamLock
+static Uint32 RingTail = 0;	// chunks handed back
+
+static TexRequest* Next_Queued(){
+	TexRequest* best = NULL;
+	int i;
+	for(i = 0; i < TEX_MAX_REQUESTS;i++){
+		TexRequest* r = &Requests[i];
+		if(r->state == TEX_QUEUED && (best == NULL || r->seq < best->seq))
+			best = r;
+	}
+	return best;
+}
+
+/*
+	Loader thread, waits for a free chunk. NULL when shutting down or
+	the main thread dropped the request
+*/
+static Uint8* Ring_Claim(TexRequest* r){
+	Uint8* c = NULL;
+	mutex_lock(&StreamLock);
+	while(!StreamQuit && !r->dropped && RingHead - RingTail >= TEX_RING)
+		cond_wait(&StreamCond,&StreamLock);
+	if(!StreamQuit && !r->dropped)
+		c = Ring[RingHead % TEX_RING];
+	mutex_unlock(&StreamLock);
+	return c;
+}
+
+static void Ring_Fill(TexRequest* r,Uint32 len){
+	mutex_lock(&StreamLock);
+	RingLen[RingHead % TEX_RING] = len;
+	RingHead++;
+	r->filled++;
+	mutex_unlock(&StreamLock);
+}
+
+/*
+	Main thread, hands back a chunk. Called with StreamLock held
+*/
+static void Ring_Return(TexRequest* r,Uint32 chunks){
+	RingTail += chunks;
+	r->taken += chunks;
+	cond_broadcast(&StreamCond);
+}
+
+/*
+	Loader thread, reads or inflates the payload into the ring a chunk
+	at a time. The request goes ready before the first chunk so the
+	uploads start right away, fetching keeps the main thread from
+	finishing it until the file is closed
+*/
+static int Tex_Fetch_Chunks(TexRequest* r,const Uint8* map){
+	TexZ z;
+	Uint8* in = NULL;
+	Uint8* c;
+	Uint32 off = 0,n;
+	int zip = Tex_Compressed(&r->hdr);
+	int ok = 0;
+
+	if(zip){
+		in = map ? NULL : malloc(TEX_CHUNK);
+		if((map == NULL && in == NULL)
+			|| Z_Begin(&z,&r->f,map,map ? Tex_Size(&r->f) - sizeof(header_t) : 0,in) != 0){
+			free(in);
+			Tex_Close(&r->f);
+			return -1;
+		}
+	}
+	r->chunked = 1;
+	mutex_lock(&StreamLock);
+	r->state = TEX_READY;
+	mutex_unlock(&StreamLock);
+	while(ok == 0 && off < (Uint32)r->hdr.size){
+		n = MIN((Uint32)r->hdr.size - off,TEX_CHUNK);
+		c = Ring_Claim(r);
+		if(c == NULL || (zip ? Z_Read(&z,c,n) != 0 : Tex_Read(&r->f,c,n) != (int)n)){
+			ok = -1;
+			break;
+		}
+		Ring_Fill(r,n);
+		off += n;
+	}
+	if(zip)
+		Z_End(&z);
+	free(in);
+	Tex_Close(&r->f);
+	return ok;
+}
+
+/*
+	Loader thread side, leaves the texture data mapped for the main
+	thread to upload or starts feeding it through the ring. The palette
+	is read here too so the main thread never touches the file
+*/
+static int Tex_Fetch(TexRequest* r){
+	Uint32 colors[256];
+	header_t hdr;
+	const Uint8* map;
+
+	if(Tex_Open(&r->f,r->fn) != 0)
+		return -1;
+	map = Tex_Map(&r->f);
+	if(map){
+		memcpy(&hdr,map,sizeof(header_t));
+		map += sizeof(header_t);
+	}else if(Tex_Read(&r->f,&hdr,sizeof(header_t)) != sizeof(header_t)){
+		Tex_Close(&r->f);
+		return -1;
+	}
+	r->invalid = !Tex_Valid(&hdr);
+	if(r->invalid
+		|| (map && Tex_Size(&r->f) < sizeof(header_t) + (Tex_Compressed(&hdr) ? 0 : hdr.size))){
+		Tex_Close(&r->f);
+		return -1;
+	}
+	r->hdr = hdr;
+	r->pal_count = Read_Palette(r->fn,hdr.type,colors);
+	if(r->pal_count >= 0){
+		r->pal = malloc(MAX(r->pal_count,1)*sizeof(Uint32));
+		if(r->pal)
+			memcpy(r->pal,colors,r->pal_count*sizeof(Uint32));
+		else
+			r->pal_count = -1;
+	}
+	if(map && !Tex_Compressed(&hdr)){
+		r->src = map;
+		r->mapped = 1;
+		return 0;
+	}
+	return Tex_Fetch_Chunks(r,map);
+}
+
+static void* Tex_Loader(void* arg){
+	TexRequest* r;
+	int ok;
+	mutex_lock(&StreamLock);
+	for(;;){
+		while(!StreamQuit && (r = Next_Queued()) == NULL)
+			cond_wait(&StreamCond,&StreamLock);
+		if(StreamQuit)
+			break;
+		r->state = TEX_READING;
+		r->fetching = 1;
+		mutex_unlock(&StreamLock);
+		ok = Tex_Fetch(r);
+		mutex_lock(&StreamLock);
+		r->state = ok == 0 ? TEX_READY : TEX_FAILED;
+		r->fetching = 0;
+	}
+	mutex_unlock(&StreamLock);
+	return NULL;
+}
+
+/*
+	Drops whatever the request still holds, main thread only once the
+	loader is done with it. Chunks a failed request never uploaded go
+	back to the ring
+*/
+static void Tex_Release(TexRequest* r){
+	if(r->mapped)
+		Tex_Close(&r->f);
+	r->mapped = 0;
+	if(r->chunked){
+		mutex_lock(&StreamLock);
+		Ring_Return(r,r->filled - r->taken);
+		mutex_unlock(&StreamLock);
+	}
+	free(r->pal);
+	r->pal = NULL;
+	r->src = NULL;
+}
+
+static void Fallback_Setup(Texture* t,int fmt,uint16 texel){
+	static uint16 texels[8*8] __attribute__((aligned(32)));
+	int i;
+	for(i = 0; i < 8*8;i++)
+		texels[i] = texel;
+	t->w = 8;
+	t->h = 8;
+	t->fmt = fmt;
+	t->palette = 0;
+	t->size = sizeof(texels);
+	t->txt = pvr_mem_malloc(sizeof(texels));
+	if(t->txt)
+		pvr_txr_load(texels,t->txt,sizeof(texels));
+}
+
+int Tex_Stream_Init(){
+	memset(Requests,0,sizeof(Requests));
+	RingHead = RingTail = 0;
+	/*
+		White so the lighting shows through as is, and a bumpmap
+		with every normal pointing straight out of the screen
+	*/
+	Fallback_Setup(&TexFallback,PVR_TXRFMT_RGB565 | PVR_TXRFMT_TWIDDLED,0xffff);
+	Fallback_Setup(&TexFallbackBump,PVR_TXRFMT_BUMP | PVR_TXRFMT_TWIDDLED,0xff00);
+	mutex_init(&StreamLock,MUTEX_TYPE_NORMAL);
+	cond_init(&StreamCond);
+	StreamQuit = 0;
+	Loader = thd_create(0,Tex_Loader,NULL);
+	return Loader == NULL ? -1 : 0;
+}
+
+void Tex_Stream_Shutdown(){
+	int i;
+	if(Loader == NULL)
+		return;
+	mutex_lock(&StreamLock);
+	StreamQuit = 1;
+	cond_broadcast(&StreamCond);
+	mutex_unlock(&StreamLock);
+	thd_join(Loader,NULL);
+	Loader = NULL;
+	for(i = 0; i < TEX_MAX_REQUESTS;i++){
+		TexRequest* r = &Requests[i];
+		if(!r->reported && (r->state == TEX_READY || r->state == TEX_FAILED)){
+			Tex_Release(r);
+			DeleteTexture(&r->tex);
+		}
+		r->state = TEX_FREE;
+	}
+	cond_destroy(&StreamCond);
+	mutex_destroy(&StreamLock);
+	DeleteTexture(&TexFallback);
+	DeleteTexture(&TexFallbackBump);
+}
+
+/*
+	Queues fn to be loaded into t, returns a handle for Tex_State() or
+	-1 when every slot is busy. Finished slots get reused oldest first,
+	so a handle only stays valid for a while after completion
+*/
+int Tex_Request(const char* fn,Texture* t,TexDone done,void* user){
+	TexRequest* r = NULL;
+	int i;
+	if(Loader == NULL || strlen(fn) >= sizeof(r->fn))
+		return -1;
+	mutex_lock(&StreamLock);
+	for(i = 0; i < TEX_MAX_REQUESTS;i++){
+		TexRequest* c = &Requests[i];
+		if(c->state == TEX_FREE){
+			r = c;
+			break;
+		}
+		if((c->state == TEX_RESIDENT || c->state == TEX_FAILED) && c->reported
+			&& (r == NULL || c->seq < r->seq))
+			r = c;
+	}
+	if(r == NULL){
+		mutex_unlock(&StreamLock);
+		return -1;
+	}
+	strcpy(r->fn,fn);
+	r->dst = t;
+	r->done = done;
+	r->user = user;
+	r->reported = 0;
+	r->mapped = 0;
+	r->chunked = 0;
+	r->src = NULL;
+	r->pal = NULL;
+	r->pal_count = -1;
+	r->off = 0;
+	r->invalid = 0;
+	r->fetching = 0;
+	r->dropped = 0;
+	r->filled = r->taken = 0;
+	r->coff = 0;
+	memset(&r->tex,0,sizeof(Texture));
+	r->seq = RequestSeq++;
+	r->gen = (r->gen + 1) & 0xffffff;
+	r->state = TEX_QUEUED;
+	cond_signal(&StreamCond);
+	mutex_unlock(&StreamLock);
+	return (int)((r->gen << 8) | (r - Requests));
+}
+
+int Tex_State(int handle){
+	TexRequest* r;
+	int state;
+	if(handle < 0 || (handle & 0xff) >= TEX_MAX_REQUESTS)
+		return -1;
+	r = &Requests[handle & 0xff];
+	mutex_lock(&StreamLock);
+	state = r->gen == (Uint32)handle >> 8 ? r->state : -1;
+	mutex_unlock(&StreamLock);
+	return state;
+}
+
+/*
+	Requests that haven't reported back yet
+*/
+int Tex_Stream_Pending(){
+	int i,n = 0;
+	mutex_lock(&StreamLock);
+	for(i = 0; i < TEX_MAX_REQUESTS;i++)
+		if(Requests[i].state != TEX_FREE && !Requests[i].reported)
+			n++;
+	mutex_unlock(&StreamLock);
+	return n;
+}
+
+static void Tex_Finish(TexRequest* r,int ok){
+	mutex_lock(&StreamLock);
+	r->state = ok == 0 ? TEX_RESIDENT : TEX_FAILED;
+	mutex_unlock(&StreamLock);
+	if(ok == 0){
+		/*
+			Swapping in over an old texture frees it only now, so a
+			reload never flashes the fallback
+		*/
+		if(r->dst->txt)
+			DeleteTexture(r->dst);
+		*r->dst = r->tex;
+	}
+	r->reported = 1;
+	if(r->done)
+		r->done(r->dst,ok,r->user);
+}
+
+/*
+	Uploads what the loader has put in the ring so far, returns the
+	budget left
+*/
+static Uint32 Upload_Chunks(TexRequest* r,Uint32 filled,Uint32 budget){
+	Uint32 n,slot;
+	while(budget > 0 && r->taken < filled){
+		slot = RingTail % TEX_RING;
+		n = MIN(RingLen[slot] - r->coff,budget);
+		pvr_txr_load(Ring[slot] + r->coff,(Uint8*)r->tex.txt + r->off,n);
+		r->off += n;
+		r->coff += n;
+		budget -= n;
+		if(r->coff == RingLen[slot]){
+			r->coff = 0;
+			mutex_lock(&StreamLock);
+			Ring_Return(r,1);
+			mutex_unlock(&StreamLock);
+		}
+	}
+	return budget;
+}
+
+/*
+	Main thread, once a frame. Uploads oldest request first until the
+	budget runs out, a texture can take several frames
+*/
+void Tex_Stream_Update(Uint32 budget){
+	TexRequest* r;
+	Uint32 n,filled = 0;
+	int i,state,fetching = 0;
+
+	budget &= ~31;
+	for(;;){
+		r = NULL;
+		mutex_lock(&StreamLock);
+		for(i = 0; i < TEX_MAX_REQUESTS;i++){
+			TexRequest* c = &Requests[i];
+			if(c->reported)
+				continue;
+			if((c->state == TEX_READY || c->state == TEX_FAILED) && (r == NULL || c->seq < r->seq))
+				r = c;
+		}
+		state = r ? r->state : TEX_FREE;
+		if(r){
+			filled = r->filled;
+			fetching = r->fetching;
+		}
+		mutex_unlock(&StreamLock);
+		if(r == NULL)
+			return;
+
+		if(state == TEX_FAILED){
+			if(r->invalid)
+				TexStats.rejected++;
+			Tex_Release(r);
+			DeleteTexture(&r->tex);
+			Tex_Finish(r,-1);
+			continue;
+		}
+		if(r->dropped){
+			if(fetching)
+				return;
+			Tex_Release(r);
+			Tex_Finish(r,-1);
+			continue;
+		}
+		if(budget == 0)
+			return;
+		if(r->tex.txt == NULL && Tex_Setup(&r->tex,&r->hdr) != 0){
+			if(fetching){
+				/*
+					The loader stops at its next chunk and fails
+					it, that's picked up above
+				*/
+				mutex_lock(&StreamLock);
+				r->dropped = 1;
+				cond_broadcast(&StreamCond);
+				mutex_unlock(&StreamLock);
+				return;
+			}
+			Tex_Release(r);
+			Tex_Finish(r,-1);
+			continue;
+		}
+		if(r->chunked){
+			budget = Upload_Chunks(r,filled,budget);
+		}else{
+			n = MIN((Uint32)r->hdr.size - r->off,budget);
+			pvr_txr_load((void*)(r->src + r->off),(Uint8*)r->tex.txt + r->off,n);
+			r->off += n;
+			budget -= n;
+		}
+		if(r->off < (Uint32)r->hdr.size || fetching)
+			return;
+
+		Tex_Count(&r->tex,r->mapped);
+		if(Tex_Compressed(&r->hdr))
+			TexStats.compressed++;
+		if(r->chunked && TexStats.scratch_peak < sizeof(Ring))
+			TexStats.scratch_peak = sizeof(Ring);
+		Apply_Palette(&r->tex,r->pal,r->pal_count);
+		Tex_Release(r);
+		Tex_Finish(r,0);
+	}
+}
+
+/*
+	Texture cache
+*/
+typedef struct {
+	char fn[64];
+	Uint32 hash;
+	Texture tex;	// what Tex_Acquire() hands out, the address never moves
+	int refs;
+	int loading;
+	int failed;	// the last load failed, the next acquire tries again
+	Uint32 used;	// LRU tick, bumped on acquire and release
+	Uint32 bytes;	// counted against the budget once resident
+}TexCacheEntry;
+
+static TexCacheEntry Cache[TEX_CACHE_SIZE];
+static TexCacheStats CacheStats;
+static Uint32 CacheTick = 0;
+
+static Uint32 Path_Hash(const char* s){
+	Uint32 h = 2166136261u;
+	while(*s)
+		h = (h ^ (Uint8)*s++) * 16777619u;
+	return h;
+}
+
+void Tex_Cache_Init(Uint32 budget){
+	memset(Cache,0,sizeof(Cache));
+	memset(&CacheStats,0,sizeof(CacheStats));
+	CacheStats.budget = budget;
+	CacheTick = 0;
+}
+
+static void Cache_Evict(TexCacheEntry* e){
+	CacheStats.resident -= e->bytes;
+	CacheStats.entries--;
+	DeleteTexture(&e->tex);
+	memset(e,0,sizeof(TexCacheEntry));
+}
+
+/*
+	Least recently used entry nobody holds, NULL when every entry is
+	in use or still loading
+*/
+static TexCacheEntry* Cache_Victim(){
+	TexCacheEntry* best = NULL;
+	int i;
+	for(i = 0; i < TEX_CACHE_SIZE;i++){
+		TexCacheEntry* e = &Cache[i];
+		if(e->fn[0] == 0 || e->refs > 0 || e->loading)
+			continue;
+		if(best == NULL || e->used < best->used)
+			best = e;
+	}
+	return best;
+}
+
+/*
+	Evicts until "bytes" more fit in the budget, returns how many
+	textures went. Also called by Tex_Setup() when VRAM is too
+	fragmented for an allocation even under budget
+*/
+int Tex_Cache_Make_Room(Uint32 bytes){
+	TexCacheEntry* e;
+	int n = 0;
+	if(CacheStats.budget == 0)
+		return 0;
+	while(bytes > CacheStats.budget || CacheStats.resident > CacheStats.budget - bytes){
+		e = Cache_Victim();
+		if(e == NULL)
+			break;
+		Cache_Evict(e);
+		CacheStats.evictions++;
+		n++;
+		if(bytes == 0xffffffff)
+			break;
+	}
+	return n;
+}
+
+void Tex_Cache_Shutdown(){
+	int i;
+	for(i = 0; i < TEX_CACHE_SIZE;i++)
+		if(Cache[i].fn[0])
+			Cache_Evict(&Cache[i]);
+}
+
+static void Cache_Done(Texture* t,int ok,void* user){
+	TexCacheEntry* e = (TexCacheEntry*)user;
+	e->loading = 0;
+	if(ok != 0){
+		e->failed = 1;
+		CacheStats.failed++;
+		return;
+	}
+	e->bytes = t->size;
+	CacheStats.resident += e->bytes;
+	if(CacheStats.resident > CacheStats.resident_peak)
+		CacheStats.resident_peak = CacheStats.resident;
+}
+
+static void Cache_Load(TexCacheEntry* e){
+	e->loading = 1;
+	e->failed = 0;
+	if(Tex_Request(e->fn,&e->tex,Cache_Done,e) < 0)
+		Cache_Done(&e->tex,Load_Texture(e->fn,&e->tex),e);
+}
+
+/*
+	Returns the shared texture for fn with a reference held, its txt
+	stays NULL until it's resident so draw it through Tex_Use(). A
+	texture that failed to load is tried again, whoever still holds
+	it picks it up once it's in
+*/
+Texture* Tex_Acquire(const char* fn){
+	TexCacheEntry* e = NULL;
+	Uint32 h = Path_Hash(fn);
+	int i;
+
+	if(strlen(fn) >= sizeof(e->fn))
+		return NULL;
+	for(i = 0; i < TEX_CACHE_SIZE;i++){
+		if(Cache[i].fn[0] && Cache[i].hash == h && strcmp(Cache[i].fn,fn) == 0){
+			e = &Cache[i];
+			e->refs++;
+			e->used = ++CacheTick;
+			CacheStats.hits++;
+			if(e->failed && !e->loading){
+				DeleteTexture(&e->tex);
+				memset(&e->tex,0,sizeof(Texture));
+				Cache_Load(e);
+			}
+			return &e->tex;
+		}
+	}
+
+	CacheStats.misses++;
+	for(i = 0; i < TEX_CACHE_SIZE && e == NULL;i++)
+		if(Cache[i].fn[0] == 0)
+			e = &Cache[i];
+	if(e == NULL){
+		e = Cache_Victim();
+		if(e == NULL)
+			return NULL;
+		Cache_Evict(e);
+		CacheStats.evictions++;
+	}
+	strcpy(e->fn,fn);
+	e->hash = h;
+	e->refs = 1;
+	e->used = ++CacheTick;
+	CacheStats.entries++;
+	Cache_Load(e);
+	return &e->tex;
+}
+
+/*
+	Drops a reference, the texture stays cached until it gets evicted.
+	A failed one goes with its last reference
+*/
+void Tex_Unref(Texture* t){
+	TexCacheEntry* e;
+	if(t == NULL)
+		return;
+	e = (TexCacheEntry*)((Uint8*)t - offsetof(TexCacheEntry,tex));
+	if(e < Cache || e >= Cache + TEX_CACHE_SIZE || e->refs <= 0)
+		return;
+	e->refs--;
+	e->used = ++CacheTick;
+	if(e->refs == 0 && e->failed && !e->loading)
+		Cache_Evict(e);
+}
+
+void Tex_Cache_Get_Stats(TexCacheStats* out){
+	*out = CacheStats;
+}
@@ -0,0 +1,121 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "light.h"
+
+/*
+	DTEX texture loading
+	- Files that can be mapped (romdisk on the Dreamcast, anything on
+	  the host) are copied straight from the mapping into VRAM
+	- Everything else is streamed through one TEX_CHUNK sized buffer,
+	  so loading never needs a RAM copy of the whole texture
+	- Files with a "DTEZ" id are zlib compressed (tools/dtexz.c) and
+	  get inflated chunk by chunk on the way to VRAM, plain "DTEX"
+	  files load as before
+	- The header's format decides how big the payload has to be, VQ
+	  (codebook then indices), twiddled, strided and mipmapped layouts
+	  are checked and anything the PVR can't draw is turned down
+*/
+
+#define TEX_CHUNK (16*1024)
+#define TEX_FMT_MIPMAP (1u << 31)	// texconv sets it, KOS has no name for it
+
+typedef struct {
+	Uint32 loads;
+	Uint32 mapped;		// loads that went straight from the mapping
+	Uint32 streamed;	// loads that went through the chunk buffer
+	Uint32 compressed;	// DTEZ loads, counted in one of the above too
+	Uint32 bytes;		// texture bytes uploaded
+	Uint32 scratch_peak;	// biggest RAM buffer a load needed
+	Uint32 twiddled;
+	Uint32 vq;
+	Uint32 vq_saved;	// VRAM the VQ textures saved over their 16/8/4bpp size
+	Uint32 rejected;	// headers with a bad format or size
+}TexLoadStats;
+
+extern TexLoadStats TexStats;
+
+int Load_Texture(const char* fn,Texture* t);
+int Load_Texture_Streamed(const char* fn,Texture* t);
+void DeleteTexture(Texture* t);
+void Tex_Print_Stats();
+
+/*
+	Background streaming
+	- A loader thread opens/maps requested files and reads their
+	  palettes off the main thread, Tex_Stream_Update() then uploads
+	  at most "budget" bytes a frame to VRAM and fires the completion
+	  callbacks
+	- Files that can't be uploaded from a mapping, and compressed
+	  ones, are read or inflated into a ring of TEX_RING chunks the
+	  uploads drain, so no request holds a whole texture in RAM
+	- The destination texture only gets filled in once it's fully
+	  resident, until then its txt is NULL and Tex_Use() hands back
+	  the fallback so drawing never waits on a load
+*/
+
+#define TEX_MAX_REQUESTS 32
+#define TEX_UPLOAD_BUDGET (64*1024)	// bytes per frame
+#define TEX_RING 4	// TEX_CHUNK buffers between the loader and the uploads
+
+enum {
+	TEX_FREE = 0,
+	TEX_QUEUED,	// waiting for the loader thread
+	TEX_READING,	// loader thread has it
+	TEX_READY,	// mapped or coming through the ring, uploading over the next frames
+	TEX_RESIDENT,
+	TEX_FAILED
+};
+
+/*
+	Called from Tex_Stream_Update() on the main thread, ok is 0 on
+	success and -1 if the file couldn't be loaded
+*/
+typedef void (*TexDone)(Texture* t,int ok,void* user);
+
+extern Texture TexFallback;	// plain white, for colour textures
+extern Texture TexFallbackBump;	// flat, for bumpmaps
+
+int Tex_Stream_Init();
+void Tex_Stream_Shutdown();
+int Tex_Request(const char* fn,Texture* t,TexDone done,void* user);
+int Tex_State(int handle);
+int Tex_Stream_Pending();
+void Tex_Stream_Update(Uint32 budget);
+
+static inline Texture* Tex_Use(Texture* t,Texture* fallback){
+	return t != NULL && t->txt != NULL ? t : fallback;
+}
+
+/*
+	Texture cache
+	- Textures are shared by path and reference counted, Tex_Acquire()
+	  streams them in on a miss (or loads them right away when the
+	  loader thread isn't running)
+	- Unreferenced textures stay resident until VRAM is needed, then
+	  the least recently used go first so the cached set stays under
+	  the budget
+*/
+
+#define TEX_CACHE_SIZE 64
+#define TEX_CACHE_BUDGET (4*1024*1024)	// leaves room for frame and vertex buffers
+
+typedef struct {
+	Uint32 hits;
+	Uint32 misses;
+	Uint32 evictions;
+	Uint32 failed;
+	Uint32 entries;
+	Uint32 resident;	// bytes of cached textures in VRAM
+	Uint32 resident_peak;
+	Uint32 budget;
+}TexCacheStats;
+
+void Tex_Cache_Init(Uint32 budget);
+void Tex_Cache_Shutdown();
+Texture* Tex_Acquire(const char* fn);
+void Tex_Unref(Texture* t);
+int Tex_Cache_Make_Room(Uint32 bytes);
+void Tex_Cache_Get_Stats(TexCacheStats* out);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+	dtexz - compresses DTEX textures for the romdisk
+	- Writes the same 16 byte header with the id changed to "DTEZ",
+	  followed by the payload as one zlib stream
+	- Files that are already DTEZ, or that don't get smaller, are
+	  copied through unchanged so the loader takes the plain path
+
+	dtexz in.raw out.raw [level]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+typedef struct {
+	char id[4];
+	short width;
+	short height;
+	unsigned int type;
+	int size;
+}header_t;
+
+static int Write_File(const char* fn,const void* a,size_t an,const void* b,size_t bn){
+	FILE* fp = fopen(fn,"wb");
+	int ok;
+	if(fp == NULL)
+		return -1;
+	ok = fwrite(a,1,an,fp) == an && fwrite(b,1,bn,fp) == bn;
+	return fclose(fp) == 0 && ok ? 0 : -1;
+}
+
+int main(int argc,char** argv){
+	header_t hdr;
+	unsigned char* src;
+	unsigned char* dst;
+	uLongf dstlen;
+	long len;
+	int level = argc > 3 ? atoi(argv[3]) : Z_BEST_COMPRESSION;
+	FILE* fp;
+
+	if(argc < 3){
+		fprintf(stderr,"usage: %s in.raw out.raw [level]\n",argv[0]);
+		return 1;
+	}
+	fp = fopen(argv[1],"rb");
+	if(fp == NULL){
+		perror(argv[1]);
+		return 1;
+	}
+	fseek(fp,0,SEEK_END);
+	len = ftell(fp);
+	fseek(fp,0,SEEK_SET);
+	if(len < (long)sizeof(hdr) || fread(&hdr,sizeof(hdr),1,fp) != 1
+		|| (memcmp(hdr.id,"DTEX",4) != 0 && memcmp(hdr.id,"DTEZ",4) != 0)){
+		fprintf(stderr,"%s: not a DTEX file\n",argv[1]);
+		fclose(fp);
+		return 1;
+	}
+	len -= sizeof(hdr);
+	src = malloc(len);
+	if(src == NULL || fread(src,1,len,fp) != (size_t)len){
+		fprintf(stderr,"%s: short read\n",argv[1]);
+		fclose(fp);
+		return 1;
+	}
+	fclose(fp);
+
+	if(memcmp(hdr.id,"DTEZ",4) == 0 || len < hdr.size){
+		if(Write_File(argv[2],&hdr,sizeof(hdr),src,len) != 0){
+			perror(argv[2]);
+			return 1;
+		}
+		return 0;
+	}
+
+	dstlen = compressBound(hdr.size);
+	dst = malloc(dstlen);
+	if(dst == NULL || compress2(dst,&dstlen,src,hdr.size,level) != Z_OK){
+		fprintf(stderr,"%s: compression failed\n",argv[1]);
+		return 1;
+	}
+	if(dstlen < (uLongf)hdr.size){
+		memcpy(hdr.id,"DTEZ",4);
+		if(Write_File(argv[2],&hdr,sizeof(hdr),dst,dstlen) != 0){
+			perror(argv[2]);
+			return 1;
+		}
+	}else if(Write_File(argv[2],&hdr,sizeof(hdr),src,len) != 0){
+		perror(argv[2]);
+		return 1;
+	}
+	printf("%s: %d -> %lu bytes\n",argv[1],hdr.size,(unsigned long)(dstlen < (uLongf)hdr.size ? dstlen : hdr.size));
+	free(src);
+	free(dst);
+	return 0;
+}
@@ -0,0 +1,331 @@
+/*
+	mkassets - converts the source images listed in assets.txt into the
+	romdisk directory
+	- Every asset runs texconv in its own process, up to -j at a time
+	- Each output is keyed by a hash of its source image, arguments and
+	  the texconv binary, outputs whose key is unchanged in the
+	  manifest are skipped
+	- Outputs are written to "<out>/.tmp" and renamed into place, so a
+	  failed run never leaves half a texture on the romdisk
+
+	mkassets [-j jobs] [-t texconv] [-z dtexz] [-o dir] [-m manifest] assets.txt
+
+	assets.txt has one asset per line, "#" starts a comment:
+	output source texconv-arguments...
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_ASSETS 1024
+#define MAX_ARGS 32
+
+typedef unsigned long long uint64;
+
+typedef struct {
+	char out[128];
+	char src[256];
+	char* args[MAX_ARGS];
+	int argc;
+	uint64 hash;
+	pid_t pid;
+	int state;	// 0 todo, 1 running, 2 done, 3 skipped, -1 failed
+}Asset;
+
+typedef struct {
+	char out[128];
+	uint64 hash;
+}CacheEntry;
+
+static Asset Assets[MAX_ASSETS];
+static int AssetCount = 0;
+static CacheEntry Cache[MAX_ASSETS];
+static int CacheCount = 0;
+
+static const char* Texconv = "texconv";
+static const char* Dtexz = NULL;
+static const char* OutDir = "romdisk";
+static const char* Manifest = "romdisk.manifest";
+
+/*
+	FNV-1a over files and strings
+*/
+static uint64 Hash_Bytes(uint64 h,const void* data,size_t n){
+	const unsigned char* p = (const unsigned char*)data;
+	while(n--)
+		h = (h ^ *p++) * 1099511628211ull;
+	return h;
+}
+
+static int Hash_File(uint64* h,const char* fn){
+	unsigned char buf[65536];
+	size_t n;
+	FILE* fp = fopen(fn,"rb");
+	if(fp == NULL)
+		return -1;
+	while((n = fread(buf,1,sizeof(buf),fp)) > 0)
+		*h = Hash_Bytes(*h,buf,n);
+	fclose(fp);
+	return 0;
+}
+
+/*
+	Finds texconv on PATH when it isn't given as a path, only so its
+	binary can go into the hash
+*/
+static const char* Find_Tool(const char* tool,char* buf,size_t len){
+	const char* path = getenv("PATH");
+	const char* p;
+	if(strchr(tool,'/') || path == NULL)
+		return tool;
+	while(*path){
+		p = strchr(path,':');
+		if(p == NULL)
+			p = path + strlen(path);
+		snprintf(buf,len,"%.*s/%s",(int)(p - path),path,tool);
+		if(access(buf,X_OK) == 0)
+			return buf;
+		path = *p ? p + 1 : p;
+	}
+	return tool;
+}
+
+static int Load_Assets(const char* fn){
+	char line[1024];
+	FILE* fp = fopen(fn,"r");
+	if(fp == NULL){
+		perror(fn);
+		return -1;
+	}
+	while(fgets(line,sizeof(line),fp)){
+		Asset* a = &Assets[AssetCount];
+		char* tok;
+		char* save;
+		if(strchr(line,'#'))
+			*strchr(line,'#') = 0;
+		tok = strtok_r(line," \t\r\n",&save);
+		if(tok == NULL)
+			continue;
+		if(AssetCount == MAX_ASSETS){
+			fprintf(stderr,"%s: too many assets\n",fn);
+			break;
+		}
+		snprintf(a->out,sizeof(a->out),"%s",tok);
+		tok = strtok_r(NULL," \t\r\n",&save);
+		if(tok == NULL){
+			fprintf(stderr,"%s: %s has no source\n",fn,a->out);
+			continue;
+		}
+		snprintf(a->src,sizeof(a->src),"%s",tok);
+		a->argc = 0;
+		while((tok = strtok_r(NULL," \t\r\n",&save)) && a->argc < MAX_ARGS)
+			a->args[a->argc++] = strdup(tok);
+		AssetCount++;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static void Load_Manifest(){
+	char line[512];
+	FILE* fp = fopen(Manifest,"r");
+	if(fp == NULL)
+		return;
+	while(fgets(line,sizeof(line),fp) && CacheCount < MAX_ASSETS){
+		CacheEntry* c = &Cache[CacheCount];
+		if(sscanf(line,"%127s %llx",c->out,&c->hash) == 2)
+			CacheCount++;
+	}
+	fclose(fp);
+}
+
+static int Cached(const Asset* a){
+	char path[512];
+	struct stat st;
+	int i;
+	if(snprintf(path,sizeof(path),"%s/%s",OutDir,a->out) >= (int)sizeof(path) || stat(path,&st) != 0)
+		return 0;
+	for(i = 0; i < CacheCount;i++)
+		if(strcmp(Cache[i].out,a->out) == 0)
+			return Cache[i].hash == a->hash;
+	return 0;
+}
+
+static int Run(char** argv){
+	pid_t pid = fork();
+	int status;
+	if(pid == 0){
+		execvp(argv[0],argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+	if(pid < 0 || waitpid(pid,&status,0) < 0)
+		return -1;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/*
+	Child process side of one asset, texconv into the temp directory,
+	optionally dtexz, then rename the results into place
+*/
+static int Build(const Asset* a){
+	char tmp[512],tmpz[512],dst[512];
+	char* argv[MAX_ARGS + 8];
+	int n = 0,i;
+
+	snprintf(tmp,sizeof(tmp),"%s/.tmp/%s",OutDir,a->out);
+	snprintf(dst,sizeof(dst),"%s/%s",OutDir,a->out);
+	argv[n++] = (char*)Texconv;
+	argv[n++] = "-i";
+	argv[n++] = (char*)a->src;
+	argv[n++] = "-o";
+	argv[n++] = tmp;
+	for(i = 0; i < a->argc;i++)
+		argv[n++] = a->args[i];
+	argv[n] = NULL;
+	if(Run(argv) != 0)
+		return -1;
+
+	if(Dtexz){
+		if(snprintf(tmpz,sizeof(tmpz),"%s.z",tmp) >= (int)sizeof(tmpz))
+			return -1;
+		argv[0] = (char*)Dtexz;
+		argv[1] = tmp;
+		argv[2] = tmpz;
+		argv[3] = NULL;
+		if(Run(argv) != 0 || rename(tmpz,tmp) != 0)
+			return -1;
+	}
+	/*
+		Paletted formats come with a .pal next to the texture
+	*/
+	if(snprintf(tmpz,sizeof(tmpz),"%s.pal",tmp) < (int)sizeof(tmpz) && access(tmpz,F_OK) == 0){
+		char dstpal[520];
+		snprintf(dstpal,sizeof(dstpal),"%s.pal",dst);
+		if(rename(tmpz,dstpal) != 0)
+			return -1;
+	}
+	return rename(tmp,dst);
+}
+
+static int Write_Manifest(){
+	FILE* fp = fopen(Manifest,"w");
+	int i;
+	if(fp == NULL){
+		perror(Manifest);
+		return -1;
+	}
+	fprintf(fp,"# output hash source, written by mkassets\n");
+	for(i = 0; i < AssetCount;i++)
+		if(Assets[i].state == 2 || Assets[i].state == 3)
+			fprintf(fp,"%s %016llx %s\n",Assets[i].out,Assets[i].hash,Assets[i].src);
+	return fclose(fp);
+}
+
+int main(int argc,char** argv){
+	char toolpath[1024],dir[512];
+	uint64 toolhash = 1469598103934665603ull;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	int running = 0,next = 0,failed = 0,built = 0,skipped = 0;
+	int opt,i;
+
+	while((opt = getopt(argc,argv,"j:t:z:o:m:")) != -1){
+		switch(opt){
+		case 'j': jobs = atoi(optarg); break;
+		case 't': Texconv = optarg; break;
+		case 'z': Dtexz = optarg; break;
+		case 'o': OutDir = optarg; break;
+		case 'm': Manifest = optarg; break;
+		default:
+			fprintf(stderr,"usage: %s [-j jobs] [-t texconv] [-z dtexz] [-o dir] [-m manifest] assets.txt\n",argv[0]);
+			return 1;
+		}
+	}
+	if(optind >= argc || Load_Assets(argv[optind]) != 0)
+		return 1;
+	if(jobs < 1)
+		jobs = 1;
+
+	if(Hash_File(&toolhash,Find_Tool(Texconv,toolpath,sizeof(toolpath))) != 0)
+		fprintf(stderr,"warning: can't read %s, it won't be part of the hash\n",Texconv);
+	if(Dtexz)
+		Hash_File(&toolhash,Dtexz);
+	Load_Manifest();
+
+	for(i = 0; i < AssetCount;i++){
+		Asset* a = &Assets[i];
+		int j;
+		a->hash = toolhash;
+		if(Hash_File(&a->hash,a->src) != 0){
+			fprintf(stderr,"%s: %s\n",a->src,strerror(errno));
+			a->state = -1;
+			failed++;
+			continue;
+		}
+		for(j = 0; j < a->argc;j++)
+			a->hash = Hash_Bytes(a->hash,a->args[j],strlen(a->args[j]) + 1);
+		a->hash = Hash_Bytes(a->hash,Dtexz ? "z" : "",Dtexz ? 2 : 1);
+		if(Cached(a)){
+			a->state = 3;
+			skipped++;
+		}
+	}
+
+	snprintf(dir,sizeof(dir),"%s/.tmp",OutDir);
+	mkdir(OutDir,0777);
+	mkdir(dir,0777);
+
+	/*
+		Keep "jobs" builds going until everything has finished
+	*/
+	for(;;){
+		int status;
+		pid_t pid;
+		while(running < jobs && next < AssetCount){
+			Asset* a = &Assets[next++];
+			if(a->state != 0)
+				continue;
+			a->pid = fork();
+			if(a->pid == 0)
+				_exit(Build(a) == 0 ? 0 : 1);
+			if(a->pid < 0){
+				a->state = -1;
+				failed++;
+				continue;
+			}
+			a->state = 1;
+			running++;
+		}
+		if(running == 0)
+			break;
+		pid = wait(&status);
+		if(pid < 0)
+			break;
+		for(i = 0; i < AssetCount;i++){
+			Asset* a = &Assets[i];
+			if(a->state != 1 || a->pid != pid)
+				continue;
+			running--;
+			if(WIFEXITED(status) && WEXITSTATUS(status) == 0){
+				a->state = 2;
+				built++;
+				printf("built %s\n",a->out);
+			}else{
+				a->state = -1;
+				failed++;
+				fprintf(stderr,"failed %s (%s)\n",a->out,a->src);
+			}
+		}
+	}
+	rmdir(dir);
+
+	Write_Manifest();
+	printf("%d built, %d up to date, %d failed\n",built,skipped,failed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+/*
+	mkatlas - packs DTEX textures into one atlas texture
+	- Inputs must share a pixel format (RGB565, ARGB1555, ARGB4444 or
+	  BUMP, so tile textures and normal maps go in separate atlases).
+	  Twiddled, non-twiddled and VQ inputs are all accepted
+	- The atlas comes out twiddled and uncompressed, run it through
+	  texconv/dtexz afterwards if it should be VQ or zlib'd
+	- "<out>.atl" lists every region by input name (no directory or
+	  extension), Load_Atlas() in atlas.c reads it back
+	- Layout only depends on names and sizes, so normal maps packed
+	  under the same names line up with their colour atlas
+
+	mkatlas out.raw in1.raw [in2.raw ...]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_INPUTS 256
+#define MAX_SIZE 1024
+
+typedef struct {
+	char id[4];
+	short width;
+	short height;
+	unsigned int type;
+	int size;
+}header_t;
+
+typedef struct {
+	char name[32];
+	int w,h;
+	int x,y;
+	unsigned short* pixels;	// linear, row by row
+}Input;
+
+static Input Inputs[MAX_INPUTS];
+static int InputCount = 0;
+
+static unsigned int Twiddle(unsigned int x,unsigned int y,unsigned int w,unsigned int h){
+	unsigned int min = w < h ? w : h;
+	unsigned int idx = 0,bit = 0,i;
+	for(i = 1; i < min;i <<= 1){
+		idx |= ((y & i) ? 1u : 0u) << bit;
+		idx |= ((x & i) ? 1u : 0u) << (bit + 1);
+		bit += 2;
+	}
+	if(w > h)
+		idx += (x / min) * min * min;
+	else if(h > w)
+		idx += (y / min) * min * min;
+	return idx;
+}
+
+static int Pow2(int n){
+	return n >= 8 && n <= MAX_SIZE && (n & (n - 1)) == 0;
+}
+
+/*
+	Reads a texture and untwiddles / expands its VQ codebook into
+	plain 16 bit pixels
+*/
+static int Load_Input(Input* in,const char* fn,unsigned int* pixfmt){
+	header_t hdr;
+	unsigned char* data;
+	const char* base;
+	int vq,twiddled,x,y;
+	size_t len;
+	FILE* fp = fopen(fn,"rb");
+
+	if(fp == NULL){
+		perror(fn);
+		return -1;
+	}
+	if(fread(&hdr,sizeof(hdr),1,fp) != 1 || memcmp(hdr.id,"DTEX",4) != 0){
+		fprintf(stderr,"%s: not an uncompressed DTEX file\n",fn);
+		fclose(fp);
+		return -1;
+	}
+	if(*pixfmt == 0xffffffff)
+		*pixfmt = (hdr.type >> 27) & 7;
+	if(((hdr.type >> 27) & 7) != *pixfmt || *pixfmt > 4 || *pixfmt == 3){
+		fprintf(stderr,"%s: pixel format differs from the first input or isn't 16 bit\n",fn);
+		fclose(fp);
+		return -1;
+	}
+	if(!Pow2(hdr.width) || !Pow2(hdr.height)){
+		fprintf(stderr,"%s: %dx%d isn't a power of two\n",fn,hdr.width,hdr.height);
+		fclose(fp);
+		return -1;
+	}
+	vq = (hdr.type >> 30) & 1;
+	twiddled = vq || !((hdr.type >> 26) & 1);
+	len = vq ? 2048 + (size_t)hdr.width*hdr.height/4 : (size_t)hdr.width*hdr.height*2;
+	data = malloc(len);
+	if(data == NULL || hdr.size < (int)len || fread(data,1,len,fp) != len){
+		fprintf(stderr,"%s: short read\n",fn);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	in->w = hdr.width;
+	in->h = hdr.height;
+	in->pixels = malloc((size_t)in->w*in->h*2);
+	for(y = 0; y < in->h;y++){
+		for(x = 0; x < in->w;x++){
+			unsigned short p;
+			if(vq){
+				const unsigned short* book = (const unsigned short*)data;
+				unsigned char code = data[2048 + Twiddle(x >> 1,y >> 1,in->w >> 1,in->h >> 1)];
+				p = book[code*4 + (((x & 1) << 1) | (y & 1))];
+			}else{
+				p = ((unsigned short*)data)[twiddled ? Twiddle(x,y,in->w,in->h) : (unsigned int)(y*in->w + x)];
+			}
+			in->pixels[y*in->w + x] = p;
+		}
+	}
+	free(data);
+
+	base = strrchr(fn,'/');
+	base = base ? base + 1 : fn;
+	snprintf(in->name,sizeof(in->name),"%s",base);
+	if(strchr(in->name,'.'))
+		*strchr(in->name,'.') = 0;
+	return 0;
+}
+
+static int Cmp_Input(const void* a,const void* b){
+	const Input* x = (const Input*)a;
+	const Input* y = (const Input*)b;
+	if(x->h != y->h)
+		return y->h - x->h;
+	if(x->w != y->w)
+		return y->w - x->w;
+	return strcmp(x->name,y->name);
+}
+
+/*
+	Shelf packing, inputs are sorted tallest first and every size is
+	a power of two so the shelves fill up without gaps
+*/
+static int Pack(int w,int h){
+	int x = 0,y = 0,shelf = 0,i;
+	for(i = 0; i < InputCount;i++){
+		Input* in = &Inputs[i];
+		if(x + in->w > w){
+			x = 0;
+			y += shelf;
+			shelf = 0;
+		}
+		if(in->w > w || y + in->h > h)
+			return -1;
+		in->x = x;
+		in->y = y;
+		x += in->w;
+		if(in->h > shelf)
+			shelf = in->h;
+	}
+	return 0;
+}
+
+int main(int argc,char** argv){
+	unsigned int pixfmt = 0xffffffff;
+	unsigned short* atlas;
+	header_t hdr;
+	char atl[512];
+	int w = 8,h = 8,area = 0,i,x,y;
+	FILE* fp;
+
+	if(argc < 3 || argc - 2 > MAX_INPUTS){
+		fprintf(stderr,"usage: %s out.raw in1.raw [in2.raw ...]\n",argv[0]);
+		return 1;
+	}
+	for(i = 2; i < argc;i++){
+		if(Load_Input(&Inputs[InputCount],argv[i],&pixfmt) != 0)
+			return 1;
+		area += Inputs[InputCount].w * Inputs[InputCount].h;
+		InputCount++;
+	}
+	qsort(Inputs,InputCount,sizeof(Input),Cmp_Input);
+
+	/*
+		Smallest atlas that fits, growing the width first so it stays
+		square or twice as wide as tall
+	*/
+	while(w * h < area || Pack(w,h) != 0){
+		if(w > h)
+			h <<= 1;
+		else
+			w <<= 1;
+		if(w > MAX_SIZE || h > MAX_SIZE){
+			fprintf(stderr,"inputs don't fit in a %dx%d atlas\n",MAX_SIZE,MAX_SIZE);
+			return 1;
+		}
+	}
+
+	atlas = calloc((size_t)w*h,2);
+	for(i = 0; i < InputCount;i++){
+		Input* in = &Inputs[i];
+		for(y = 0; y < in->h;y++)
+			for(x = 0; x < in->w;x++)
+				atlas[Twiddle(in->x + x,in->y + y,w,h)] = in->pixels[y*in->w + x];
+	}
+
+	memcpy(hdr.id,"DTEX",4);
+	hdr.width = w;
+	hdr.height = h;
+	hdr.type = pixfmt << 27;
+	hdr.size = w*h*2;
+	fp = fopen(argv[1],"wb");
+	if(fp == NULL || fwrite(&hdr,sizeof(hdr),1,fp) != 1 || fwrite(atlas,2,(size_t)w*h,fp) != (size_t)w*h){
+		perror(argv[1]);
+		return 1;
+	}
+	fclose(fp);
+
+	snprintf(atl,sizeof(atl),"%s.atl",argv[1]);
+	fp = fopen(atl,"w");
+	if(fp == NULL){
+		perror(atl);
+		return 1;
+	}
+	fprintf(fp,"DATL %d %d %d\n",w,h,InputCount);
+	for(i = 0; i < InputCount;i++)
+		fprintf(fp,"%s %d %d %d %d\n",Inputs[i].name,Inputs[i].x,Inputs[i].y,Inputs[i].w,Inputs[i].h);
+	fclose(fp);
+	printf("%s: %d textures in %dx%d, %d%% used\n",argv[1],InputCount,w,h,area * 100 / (w*h));
+	return 0;
+}
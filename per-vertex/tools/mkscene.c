@@ -0,0 +1,248 @@
+/*
+	mkscene - compiles a text scene description into a DSCN file
+	(scenefmt.h), one command per line, "#" starts a comment:
+
+	grid <cols> <rows> <tile w> <tile h> [z]
+	texture <name> <path> [atlas region]
+	fill <texture|-> [bumpmap|-]		every tile
+	tile <col> <row> <texture|-> [bumpmap|-]
+	light <x> <y> <z> <r> <g> <b> <a> <ac> <ab> <aa> <radius> [static|dynamic]
+	occluder <x1> <y1> <x2> <y2>
+	ambient <r> <g> <b>
+	hemisphere <sky r g b> <ground r g b> [up x y z]	up defaults to 0 0 1
+
+	mkscene in.txt out.scn
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../scenefmt.h"
+
+#define MAX_TEXTURES 1024
+#define MAX_TILES 65536
+#define MAX_LIGHTS 256
+#define MAX_OCCLUDERS 1024
+#define MAX_STRINGS 65536
+
+static SceneHeader Hdr;
+static SceneTexture Textures[MAX_TEXTURES];
+static char TextureNames[MAX_TEXTURES][32];
+static SceneTile Tiles[MAX_TILES];
+static SceneLight Lights[MAX_LIGHTS];
+static SceneOccluder Occluders[MAX_OCCLUDERS];
+static char Strings[MAX_STRINGS];
+static unsigned int StringSize = 0;
+
+static const char* File;
+static int Line;
+
+static void Fail(const char* msg,const char* arg){
+	fprintf(stderr,"%s:%d: %s%s%s\n",File,Line,msg,arg ? " " : "",arg ? arg : "");
+	exit(1);
+}
+
+static unsigned int Add_String(const char* s){
+	unsigned int off;
+	size_t n = strlen(s) + 1;
+	for(off = 0; off < StringSize;off += strlen(Strings + off) + 1)
+		if(strcmp(Strings + off,s) == 0)
+			return off;
+	if(StringSize + n > MAX_STRINGS)
+		Fail("string table full",NULL);
+	off = StringSize;
+	memcpy(Strings + off,s,n);
+	StringSize += n;
+	return off;
+}
+
+static unsigned short Find_Texture(const char* name){
+	unsigned int i;
+	if(name == NULL || strcmp(name,"-") == 0)
+		return SCENE_NONE;
+	for(i = 0; i < Hdr.textures.count;i++)
+		if(strcmp(TextureNames[i],name) == 0)
+			return i;
+	Fail("unknown texture",name);
+	return SCENE_NONE;
+}
+
+static float Float_Arg(char** tok,int i){
+	char* end;
+	float f;
+	if(tok[i] == NULL)
+		Fail("missing argument",NULL);
+	f = strtof(tok[i],&end);
+	if(*end)
+		Fail("not a number:",tok[i]);
+	return f;
+}
+
+static void Command(char** tok,int n){
+	unsigned int i;
+	if(strcmp(tok[0],"grid") == 0){
+		if(n < 5)
+			Fail("grid needs cols rows tile_w tile_h",NULL);
+		Hdr.grid_w = atoi(tok[1]);
+		Hdr.grid_h = atoi(tok[2]);
+		Hdr.tile_w = Float_Arg(tok,3);
+		Hdr.tile_h = Float_Arg(tok,4);
+		Hdr.z = n > 5 ? Float_Arg(tok,5) : 1.0f;
+		if(Hdr.grid_w * Hdr.grid_h > MAX_TILES || Hdr.grid_w == 0 || Hdr.grid_h == 0)
+			Fail("bad grid size",NULL);
+		Hdr.tiles.count = Hdr.grid_w * Hdr.grid_h;
+		for(i = 0; i < Hdr.tiles.count;i++)
+			Tiles[i].texture = Tiles[i].bumpmap = SCENE_NONE;
+	}else if(strcmp(tok[0],"texture") == 0){
+		SceneTexture* t = &Textures[Hdr.textures.count];
+		if(n < 3)
+			Fail("texture needs a name and a path",NULL);
+		if(Hdr.textures.count == MAX_TEXTURES)
+			Fail("too many textures",NULL);
+		snprintf(TextureNames[Hdr.textures.count],32,"%s",tok[1]);
+		t->path = Add_String(tok[2]);
+		t->region = n > 3 ? Add_String(tok[3]) : SCENE_NO_STRING;
+		Hdr.textures.count++;
+	}else if(strcmp(tok[0],"fill") == 0 || strcmp(tok[0],"tile") == 0){
+		int fill = tok[0][0] == 'f';
+		int a = fill ? 1 : 3;
+		unsigned short tex,bump;
+		if(Hdr.tiles.count == 0)
+			Fail("grid has to come first",NULL);
+		if(n < a + 1)
+			Fail("missing texture",NULL);
+		tex = Find_Texture(tok[a]);
+		bump = Find_Texture(n > a + 1 ? tok[a+1] : NULL);
+		for(i = 0; i < Hdr.tiles.count;i++){
+			if(!fill && i != atoi(tok[2]) * Hdr.grid_w + atoi(tok[1]))
+				continue;
+			Tiles[i].texture = tex;
+			Tiles[i].bumpmap = bump;
+		}
+		if(!fill && ((unsigned)atoi(tok[1]) >= Hdr.grid_w || (unsigned)atoi(tok[2]) >= Hdr.grid_h))
+			Fail("tile outside the grid",NULL);
+	}else if(strcmp(tok[0],"light") == 0){
+		SceneLight* l = &Lights[Hdr.lights.count];
+		if(n < 12)
+			Fail("light needs x y z r g b a ac ab aa radius",NULL);
+		if(Hdr.lights.count == MAX_LIGHTS)
+			Fail("too many lights",NULL);
+		l->x = Float_Arg(tok,1);
+		l->y = Float_Arg(tok,2);
+		l->z = Float_Arg(tok,3);
+		l->r = Float_Arg(tok,4);
+		l->g = Float_Arg(tok,5);
+		l->b = Float_Arg(tok,6);
+		l->a = Float_Arg(tok,7);
+		l->ac = Float_Arg(tok,8);
+		l->ab = Float_Arg(tok,9);
+		l->aa = Float_Arg(tok,10);
+		l->radius = Float_Arg(tok,11);
+		l->flags = n > 12 && strcmp(tok[12],"dynamic") == 0 ? SCENE_LIGHT_DYNAMIC : 0;
+		if(n > 12 && strcmp(tok[12],"dynamic") != 0 && strcmp(tok[12],"static") != 0)
+			Fail("light has to be static or dynamic, not",tok[12]);
+		Hdr.lights.count++;
+	}else if(strcmp(tok[0],"occluder") == 0){
+		SceneOccluder* o = &Occluders[Hdr.occluders.count];
+		if(Hdr.occluders.count == MAX_OCCLUDERS)
+			Fail("too many occluders",NULL);
+		o->x1 = Float_Arg(tok,1);
+		o->y1 = Float_Arg(tok,2);
+		o->x2 = Float_Arg(tok,3);
+		o->y2 = Float_Arg(tok,4);
+		Hdr.occluders.count++;
+	}else if(strcmp(tok[0],"ambient") == 0){
+		for(i = 0; i < 3;i++)
+			Hdr.ambient[i] = Float_Arg(tok,i + 1);
+	}else if(strcmp(tok[0],"hemisphere") == 0){
+		if(n < 7)
+			Fail("hemisphere needs sky r g b and ground r g b",NULL);
+		for(i = 0; i < 3;i++){
+			Hdr.sky[i] = Float_Arg(tok,i + 1);
+			Hdr.ground[i] = Float_Arg(tok,i + 4);
+			Hdr.up[i] = n > 7 ? Float_Arg(tok,i + 7) : (i == 2 ? 1.0f : 0.0f);
+		}
+		if(Hdr.up[0] == 0.0f && Hdr.up[1] == 0.0f && Hdr.up[2] == 0.0f)
+			Fail("hemisphere up can't be 0 0 0",NULL);
+	}else{
+		Fail("unknown command",tok[0]);
+	}
+}
+
+static unsigned int Place(SceneSection* sec,unsigned int off,unsigned int bytes){
+	sec->offset = off;
+	return (off + bytes + 3) & ~3u;
+}
+
+static void Write(FILE* fp,const void* data,unsigned int bytes,unsigned int* at,unsigned int to){
+	static const char zero[4] = {0};
+	if(*at < to)
+		fwrite(zero,1,to - *at,fp);
+	fwrite(data,1,bytes,fp);
+	*at = to + bytes;
+}
+
+int main(int argc,char** argv){
+	char buf[1024];
+	char* tok[16];
+	unsigned int off,at = 0;
+	FILE* fp;
+
+	if(argc != 3){
+		fprintf(stderr,"usage: %s in.txt out.scn\n",argv[0]);
+		return 1;
+	}
+	File = argv[1];
+	Hdr.up[2] = 1.0f;
+	fp = fopen(File,"r");
+	if(fp == NULL){
+		perror(File);
+		return 1;
+	}
+	while(fgets(buf,sizeof(buf),fp)){
+		int n = 0;
+		Line++;
+		if(strchr(buf,'#'))
+			*strchr(buf,'#') = 0;
+		tok[n] = strtok(buf," \t\r\n");
+		while(tok[n] && n < 15)
+			tok[++n] = strtok(NULL," \t\r\n");
+		tok[n] = NULL;
+		if(n)
+			Command(tok,n);
+	}
+	fclose(fp);
+	if(Hdr.tiles.count == 0)
+		Fail("no grid",NULL);
+
+	memcpy(Hdr.id,"DSCN",4);
+	Hdr.version = SCENE_VERSION;
+	Hdr.strings.count = StringSize;
+	off = (sizeof(SceneHeader) + 3) & ~3u;
+	off = Place(&Hdr.textures,off,Hdr.textures.count * sizeof(SceneTexture));
+	off = Place(&Hdr.tiles,off,Hdr.tiles.count * sizeof(SceneTile));
+	off = Place(&Hdr.lights,off,Hdr.lights.count * sizeof(SceneLight));
+	off = Place(&Hdr.occluders,off,Hdr.occluders.count * sizeof(SceneOccluder));
+	off = Place(&Hdr.strings,off,StringSize);
+	Hdr.size = off;
+
+	fp = fopen(argv[2],"wb");
+	if(fp == NULL){
+		perror(argv[2]);
+		return 1;
+	}
+	Write(fp,&Hdr,sizeof(Hdr),&at,0);
+	Write(fp,Textures,Hdr.textures.count * sizeof(SceneTexture),&at,Hdr.textures.offset);
+	Write(fp,Tiles,Hdr.tiles.count * sizeof(SceneTile),&at,Hdr.tiles.offset);
+	Write(fp,Lights,Hdr.lights.count * sizeof(SceneLight),&at,Hdr.lights.offset);
+	Write(fp,Occluders,Hdr.occluders.count * sizeof(SceneOccluder),&at,Hdr.occluders.offset);
+	Write(fp,Strings,StringSize,&at,Hdr.strings.offset);
+	Write(fp,"",0,&at,Hdr.size);
+	if(fclose(fp) != 0){
+		perror(argv[2]);
+		return 1;
+	}
+	printf("%s: %ux%u tiles, %u textures, %u lights, %u occluders, %u bytes\n",argv[2],Hdr.grid_w,Hdr.grid_h,
+		Hdr.textures.count,Hdr.lights.count,Hdr.occluders.count,Hdr.size);
+	return 0;
+}